@@ -1,58 +1,239 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <execution>
 #include <map>
 #include <mutex>
+#include <numeric>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 using namespace std::string_literals;
 
+// Хеш-таблица с целыми ключами, разбитая на полосы (stripes). Каждая полоса —
+// отдельная таблица с открытой адресацией и линейным пробированием под своим
+// мьютексом; полосы выровнены по кэш-линии, поэтому потоки, работающие с
+// соседними полосами, не мешают друг другу. Узлы не выделяются: пары хранятся
+// прямо в массиве слотов полосы.
 template <typename Key, typename Value>
 class ConcurrentMap {
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+private:
+    struct Slot {
+        Key key{};
+        Value value{};
+        // хеш внутри полосы, нужен при удалении и перестроении
+        std::uint64_t hash = 0;
+        bool is_occupied = false;
+    };
 
-    struct Bucket {
-        std::map<Key, Value> bucket_map;
+    struct alignas(64) Stripe {
         std::mutex m;
+        std::vector<Slot> slots;
+        size_t size = 0;
+
+        Value& FindOrInsert(const Key& key, std::uint64_t hash);
+        bool Erase(const Key& key, std::uint64_t hash);
+        void Grow();
     };
 
+public:
+    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+
+    // Значение по ключу, заблокированное на время жизни объекта
     struct Access {
         std::lock_guard<std::mutex> guard;
         Value& ref_to_value;
-        
-        Access(std::map<Key, Value>& bucket, std::mutex& m, const Key& key)
-            : guard(m), ref_to_value(bucket[key]) {
+
+        Access(Stripe& stripe, const Key& key, std::uint64_t hash)
+            : guard(stripe.m), ref_to_value(stripe.FindOrInsert(key, hash)) {
         }
     };
 
-    explicit ConcurrentMap(size_t bucket_count) 
-        : buckets_(bucket_count) {
+    // bucket_count — число полос, то есть независимо блокируемых частей
+    explicit ConcurrentMap(size_t bucket_count)
+        : stripes_(std::max<size_t>(bucket_count, 1)) {
     }
 
     Access operator[](const Key& key) {
-        size_t bucket_index = static_cast<size_t>(key) % buckets_.size();
-        
-        return {buckets_[bucket_index].bucket_map, buckets_[bucket_index].m, key};
+        const std::uint64_t hash = Hash(key);
+        return {GetStripe(hash), key, hash / stripes_.size()};
+    }
+
+    // Прибавляет delta к значению по ключу, отсутствующее значение считается нулевым
+    void Add(const Key& key, const Value& delta) {
+        operator[](key).ref_to_value += delta;
+    }
+
+    bool Erase(const Key& key) {
+        const std::uint64_t hash = Hash(key);
+        Stripe& stripe = GetStripe(hash);
+        std::lock_guard guard(stripe.m);
+        return stripe.Erase(key, hash / stripes_.size());
+    }
+
+    // func(const Key&, Value&) вызывается для каждой пары; полосы обходятся
+    // согласно policy, каждая под своей блокировкой
+    template <typename Policy, typename Func>
+    void ForEach(Policy&& policy, Func func) {
+        std::for_each(policy, stripes_.begin(), stripes_.end(),
+            [&func](Stripe& stripe) {
+                std::lock_guard guard(stripe.m);
+                for (Slot& slot : stripe.slots) {
+                    if (slot.is_occupied) {
+                        func(static_cast<const Key&>(slot.key), slot.value);
+                    }
+                }
+            }
+        );
+    }
+
+    // Переносит все пары в вектор (в порядке полос, не по ключам) и очищает
+    // таблицу; пары перемещаются из слотов сразу на итоговые места без
+    // промежуточных контейнеров
+    std::vector<std::pair<Key, Value>> Drain() {
+        for (Stripe& stripe : stripes_) {
+            stripe.m.lock();
+        }
+
+        std::vector<size_t> offsets(stripes_.size() + 1, 0);
+        for (size_t i = 0; i < stripes_.size(); ++i) {
+            offsets[i + 1] = offsets[i] + stripes_[i].size;
+        }
+
+        std::vector<std::pair<Key, Value>> result(offsets.back());
+        std::vector<size_t> stripe_indexes(stripes_.size());
+        std::iota(stripe_indexes.begin(), stripe_indexes.end(), 0);
+        std::for_each(std::execution::par, stripe_indexes.begin(), stripe_indexes.end(),
+            [this, &offsets, &result](size_t i) {
+                auto output = result.begin() + offsets[i];
+                for (Slot& slot : stripes_[i].slots) {
+                    if (slot.is_occupied) {
+                        *output++ = {slot.key, std::move(slot.value)};
+                    }
+                }
+                stripes_[i].slots.clear();
+                stripes_[i].size = 0;
+            }
+        );
+
+        for (Stripe& stripe : stripes_) {
+            stripe.m.unlock();
+        }
+
+        return result;
     }
 
     std::map<Key, Value> BuildOrdinaryMap() {
         std::map<Key, Value> res;
 
-        for (size_t i = 0; i < buckets_.size(); ++i) {
-            buckets_[i].m.lock();
+        for (size_t i = 0; i < stripes_.size(); ++i) {
+            stripes_[i].m.lock();
         }
-        
-        for (size_t i = 0; i < buckets_.size(); ++i) {
-            res.insert(buckets_[i].bucket_map.begin(), buckets_[i].bucket_map.end());
+
+        for (const Stripe& stripe : stripes_) {
+            for (const Slot& slot : stripe.slots) {
+                if (slot.is_occupied) {
+                    res.emplace(slot.key, slot.value);
+                }
+            }
         }
-        
-        for (size_t i = 0; i < buckets_.size(); ++i) {
-            buckets_[i].m.unlock();
+
+        for (size_t i = 0; i < stripes_.size(); ++i) {
+            stripes_[i].m.unlock();
         }
-        
+
         return res;
     }
 
 private:
-    std::vector<Bucket> buckets_;
+    std::vector<Stripe> stripes_;
+
+    // полоса выбирается по остатку от деления хеша на число полос, слот
+    // внутри полосы — по частному, поэтому они не зависят друг от друга
+    static std::uint64_t Hash(const Key& key) {
+        const std::uint64_t hash = static_cast<std::uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+        return hash ^ (hash >> 32);
+    }
+
+    Stripe& GetStripe(std::uint64_t hash) {
+        return stripes_[hash % stripes_.size()];
+    }
 };
+
+template <typename Key, typename Value>
+Value& ConcurrentMap<Key, Value>::Stripe::FindOrInsert(const Key& key, std::uint64_t hash) {
+    // заполненность держится не выше половины, чтобы цепочки проб были короткими
+    if ((size + 1) * 2 > slots.size()) {
+        Grow();
+    }
+
+    const size_t mask = slots.size() - 1;
+    for (size_t index = hash & mask;; index = (index + 1) & mask) {
+        Slot& slot = slots[index];
+        if (!slot.is_occupied) {
+            slot.key = key;
+            slot.value = Value{};
+            slot.hash = hash;
+            slot.is_occupied = true;
+            ++size;
+            return slot.value;
+        }
+        if (slot.key == key) {
+            return slot.value;
+        }
+    }
+}
+
+template <typename Key, typename Value>
+bool ConcurrentMap<Key, Value>::Stripe::Erase(const Key& key, std::uint64_t hash) {
+    if (size == 0) {
+        return false;
+    }
+
+    const size_t mask = slots.size() - 1;
+    size_t hole = hash & mask;
+    while (slots[hole].is_occupied && slots[hole].key != key) {
+        hole = (hole + 1) & mask;
+    }
+    if (!slots[hole].is_occupied) {
+        return false;
+    }
+
+    // обратный сдвиг: записи той же цепочки, чьё исходное место не лежит
+    // между дыркой и их текущим местом, переносятся в дырку, поэтому
+    // надгробия не нужны и поиск остаётся корректным
+    for (size_t next = (hole + 1) & mask; slots[next].is_occupied; next = (next + 1) & mask) {
+        const size_t home = slots[next].hash & mask;
+        const bool stays = hole <= next 
+            ? (hole < home && home <= next) 
+            : (hole < home || home <= next);
+        if (!stays) {
+            slots[hole] = std::move(slots[next]);
+            hole = next;
+        }
+    }
+    slots[hole].is_occupied = false;
+    slots[hole].value = Value{};
+    --size;
+    return true;
+}
+
+template <typename Key, typename Value>
+void ConcurrentMap<Key, Value>::Stripe::Grow() {
+    std::vector<Slot> old_slots(std::max<size_t>(slots.size() * 2, 8));
+    std::swap(slots, old_slots);
+
+    const size_t mask = slots.size() - 1;
+    for (Slot& old_slot : old_slots) {
+        if (!old_slot.is_occupied) {
+            continue;
+        }
+        size_t index = old_slot.hash & mask;
+        while (slots[index].is_occupied) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = std::move(old_slot);
+    }
+}
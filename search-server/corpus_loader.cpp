@@ -0,0 +1,146 @@
+#include "corpus_loader.h"
+#include "index_file.h"
+
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+using NewDocument = SearchServer::NewDocument;
+
+// Границы кусков [first, second) проходят по концам строк
+vector<pair<size_t, size_t>> SplitIntoChunks(const char* data, size_t size, size_t chunk_size) {
+    vector<pair<size_t, size_t>> chunks;
+    size_t begin = 0;
+    while (begin < size) {
+        size_t end = begin + min(chunk_size, size - begin);
+        if (end < size) {
+            const void* line_end = memchr(data + end, '\n', size - end);
+            end = line_end == nullptr ? size : static_cast<const char*>(line_end) - data + 1;
+        }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+    return chunks;
+}
+
+[[noreturn]] void ThrowInvalidLine(size_t offset) {
+    throw invalid_argument("Invalid corpus line at byte "s + to_string(offset));
+}
+
+template <typename Number>
+bool ParseNumber(string_view text, Number& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status) {
+    static const pair<string_view, DocumentStatus> names[] = {
+        {"ACTUAL"sv, DocumentStatus::ACTUAL},
+        {"IRRELEVANT"sv, DocumentStatus::IRRELEVANT},
+        {"BANNED"sv, DocumentStatus::BANNED},
+        {"REMOVED"sv, DocumentStatus::REMOVED},
+    };
+    for (const auto& [name, name_status] : names) {
+        if (text == name) {
+            status = name_status;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Отделяет от строки поле до табуляции
+bool TakeField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if (tab == line.npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+// Тексты документов ссылаются на data
+vector<NewDocument> ParseChunk(const char* data, size_t begin, size_t end) {
+    vector<NewDocument> documents;
+    vector<string_view> ratings;
+    size_t line_begin = begin;
+    while (line_begin < end) {
+        const void* newline = memchr(data + line_begin, '\n', end - line_begin);
+        const size_t line_end = newline == nullptr ? end : static_cast<const char*>(newline) - data;
+        string_view line(data + line_begin, line_end - line_begin);
+        const size_t offset = line_begin;
+        line_begin = line_end + 1;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+
+        NewDocument document{0, {}, DocumentStatus::ACTUAL, {}};
+        string_view id;
+        string_view status;
+        string_view rating_list;
+        if (!TakeField(line, id) || !TakeField(line, status) || !TakeField(line, rating_list)
+            || !ParseNumber(id, document.id) || !ParseStatus(status, document.status)) {
+            ThrowInvalidLine(offset);
+        }
+
+        SplitIntoWords(rating_list, ratings);
+        document.ratings.resize(ratings.size());
+        for (size_t i = 0; i < ratings.size(); ++i) {
+            if (!ParseNumber(ratings[i], document.ratings[i])) {
+                ThrowInvalidLine(offset);
+            }
+        }
+
+        document.text = line;
+        documents.push_back(move(document));
+    }
+    return documents;
+}
+
+} // namespace
+
+size_t LoadCorpus(SearchServer& search_server, const string& path,
+    const CorpusLoadOptions& options) {
+
+    const MappedFile file(path);
+    file.AdviseSequential();
+    const char* const data = file.GetData();
+    const vector<pair<size_t, size_t>> chunks =
+        SplitIntoChunks(data, file.GetSize(), max<size_t>(options.chunk_size, 1));
+
+    const size_t max_pending_chunks = options.max_pending_chunks > 0
+        ? options.max_pending_chunks
+        : 2 * max<size_t>(thread::hardware_concurrency(), 1);
+
+    // разобранные куски ждут своей очереди; при исключении деструкторы
+    // future дожидаются фоновых разборов, пока файл ещё отображён
+    deque<future<vector<NewDocument>>> pending_chunks;
+    size_t next_chunk = 0;
+    size_t document_count = 0;
+    while (next_chunk < chunks.size() || !pending_chunks.empty()) {
+        while (next_chunk < chunks.size() && pending_chunks.size() < max_pending_chunks) {
+            const auto [begin, end] = chunks[next_chunk++];
+            pending_chunks.push_back(async(launch::async, ParseChunk, data, begin, end));
+        }
+
+        const vector<NewDocument> documents = pending_chunks.front().get();
+        pending_chunks.pop_front();
+        search_server.AddDocuments(documents);
+        document_count += documents.size();
+    }
+
+    return document_count;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "search_server.h"
+
+#include <string>
+
+// Корпус — текстовый файл, по документу в строке:
+//     id<TAB>статус<TAB>рейтинги через пробел<TAB>текст
+// Статус записывается именем (ACTUAL, IRRELEVANT, BANNED, REMOVED), список
+// рейтингов может быть пустым, \r в конце строки отбрасывается.
+struct CorpusLoadOptions {
+    // примерный размер куска файла, разбираемого одним потоком и
+    // добавляемого в сервер одним пакетом
+    size_t chunk_size = 1 << 22;
+    // сколько кусков может быть разобрано, но ещё не добавлено;
+    // 0 — по два на ядро
+    size_t max_pending_chunks = 0;
+};
+
+// Загружает корпус в сервер и возвращает число добавленных документов.
+// Файл отображается в память; куски разбираются фоновыми потоками, пока
+// сервер добавляет предыдущие, и добавляются по порядку через
+// AddDocuments. Разбор не уходит вперёд больше чем на max_pending_chunks
+// кусков. При ошибке в куске (формат строки, повторный id, недопустимое
+// слово) бросается исключение, документы предыдущих кусков остаются в
+// сервере
+size_t LoadCorpus(SearchServer& search_server, const std::string& path,
+    const CorpusLoadOptions& options = {});
@@ -0,0 +1,237 @@
+#include "durable_search_server.h"
+#include "index_file.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+
+using namespace std;
+
+namespace {
+
+// недописанный снимок (см. SearchServer::Save)
+bool IsTemporary(string_view file_name) {
+    return file_name.size() > 4 && file_name.substr(file_name.size() - 4) == ".tmp"sv;
+}
+
+// Номер N из имени файла вида prefix.N или prefix.N.tmp
+optional<uint64_t> ParseGeneration(string_view file_name, string_view prefix) {
+    if (IsTemporary(file_name)) {
+        file_name.remove_suffix(4);
+    }
+    if (file_name.size() <= prefix.size() + 1 || file_name.substr(0, prefix.size()) != prefix
+        || file_name[prefix.size()] != '.') {
+        return nullopt;
+    }
+    file_name.remove_prefix(prefix.size() + 1);
+
+    uint64_t generation = 0;
+    for (const char c : file_name) {
+        if (c < '0' || c > '9') {
+            return nullopt;
+        }
+        generation = generation * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return generation;
+}
+
+// Номера готовых (не временных) файлов prefix.N по возрастанию
+vector<uint64_t> FindGenerations(const string& directory, string_view prefix) {
+    vector<uint64_t> generations;
+    for (const auto& entry : filesystem::directory_iterator(directory)) {
+        const string file_name = entry.path().filename().string();
+        const optional<uint64_t> generation = ParseGeneration(file_name, prefix);
+        if (generation && !IsTemporary(file_name)) {
+            generations.push_back(*generation);
+        }
+    }
+    sort(generations.begin(), generations.end());
+    return generations;
+}
+
+uint64_t FindLastSnapshot(const string& directory) {
+    filesystem::create_directories(directory);
+    const vector<uint64_t> generations = FindGenerations(directory, "index"sv);
+    return generations.empty() ? 0 : generations.back();
+}
+
+} // namespace
+
+DurableSearchServer::DurableSearchServer(const string& directory, string_view stop_words_text)
+    : DurableSearchServer(directory, SearchServer(stop_words_text)) {
+}
+
+DurableSearchServer::DurableSearchServer(const string& directory, const string& stop_words_text)
+    : DurableSearchServer(directory, SearchServer(stop_words_text)) {
+}
+
+DurableSearchServer::DurableSearchServer(const string& directory, SearchServer empty_server)
+    : directory_(directory)
+    , snapshot_generation_(FindLastSnapshot(directory))
+    , server_(snapshot_generation_ > 0
+          ? SearchServer::Open(GetSnapshotPath(snapshot_generation_))
+          : move(empty_server)) {
+
+    ReplayLogs();
+}
+
+void DurableSearchServer::AddDocument(int document_id, string_view document,
+    DocumentStatus status, const vector<int>& ratings) {
+
+    uint64_t sequence = 0;
+    shared_ptr<WriteAheadLog> log;
+    {
+        const lock_guard lock(mutex_);
+        server_.AddDocument(document_id, document, status, ratings);
+        sequence = log_->AppendAddDocument(document_id, document, status, ratings);
+        log = log_;
+    }
+    log->Sync(sequence);
+}
+
+void DurableSearchServer::AddDocuments(const vector<SearchServer::NewDocument>& documents) {
+    if (documents.empty()) {
+        return;
+    }
+
+    uint64_t sequence = 0;
+    shared_ptr<WriteAheadLog> log;
+    {
+        const lock_guard lock(mutex_);
+        server_.AddDocuments(documents);
+        for (const SearchServer::NewDocument& document : documents) {
+            sequence = log_->AppendAddDocument(document.id, document.text, document.status,
+                document.ratings);
+        }
+        log = log_;
+    }
+    log->Sync(sequence);
+}
+
+void DurableSearchServer::RemoveDocument(int document_id) {
+    uint64_t sequence = 0;
+    shared_ptr<WriteAheadLog> log;
+    {
+        const lock_guard lock(mutex_);
+        server_.RemoveDocument(document_id);
+        sequence = log_->AppendRemoveDocument(document_id);
+        log = log_;
+    }
+    log->Sync(sequence);
+}
+
+void DurableSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    if (document_ids.empty()) {
+        return;
+    }
+
+    uint64_t sequence = 0;
+    shared_ptr<WriteAheadLog> log;
+    {
+        const lock_guard lock(mutex_);
+        server_.RemoveDocuments(execution::par, document_ids);
+        for (const int document_id : document_ids) {
+            sequence = log_->AppendRemoveDocument(document_id);
+        }
+        log = log_;
+    }
+    log->Sync(sequence);
+}
+
+void DurableSearchServer::Checkpoint() {
+    const lock_guard checkpoint_guard(checkpoint_mutex_);
+
+    uint64_t generation = 0;
+    {
+        // Журнал меняется под разделяемой блокировкой: изменения она
+        // исключает, а запросы журнал не трогают. Между переключением
+        // журнала и снимком изменений быть не должно, иначе они попадут
+        // и в снимок, и в новый журнал
+        const shared_lock lock(mutex_);
+        generation = log_generation_ + 1;
+        log_ = make_shared<WriteAheadLog>(GetLogPath(generation));
+        log_generation_ = generation;
+        SyncPath(directory_);
+
+        server_.Save(GetSnapshotPath(generation));
+        SyncPath(directory_);
+    }
+
+    // журналы старше снимка больше не нужны; потоки, ещё ждущие их
+    // синхронизации, держат свои файлы открытыми
+    snapshot_generation_ = generation;
+    RemoveFilesBefore(generation);
+}
+
+int DurableSearchServer::GetDocumentCount() const {
+    const shared_lock lock(mutex_);
+    return server_.GetDocumentCount();
+}
+
+void DurableSearchServer::ReplayLogs() {
+    uint64_t last_generation = snapshot_generation_;
+    for (const uint64_t generation : FindGenerations(directory_, "log"sv)) {
+        if (generation < snapshot_generation_) {
+            continue;
+        }
+        last_generation = max(last_generation, generation);
+
+        const MappedFile file(GetLogPath(generation));
+        vector<WriteAheadLog::Operation> operations =
+            WriteAheadLog::Parse(file.GetData(), file.GetSize());
+
+        // подряд идущие добавления и удаления воспроизводятся пакетами
+        vector<SearchServer::NewDocument> documents;
+        vector<int> removed_document_ids;
+        const auto apply_pending = [&] {
+            if (!documents.empty()) {
+                server_.AddDocuments(documents);
+                documents.clear();
+            }
+            if (!removed_document_ids.empty()) {
+                server_.RemoveDocuments(execution::par, removed_document_ids);
+                removed_document_ids.clear();
+            }
+        };
+        for (WriteAheadLog::Operation& operation : operations) {
+            if (operation.type == WriteAheadLog::OperationType::ADD_DOCUMENT) {
+                if (!removed_document_ids.empty()) {
+                    apply_pending();
+                }
+                documents.push_back({operation.document_id, operation.document, operation.status,
+                    move(operation.ratings)});
+            } else {
+                if (!documents.empty()) {
+                    apply_pending();
+                }
+                removed_document_ids.push_back(operation.document_id);
+            }
+        }
+        apply_pending();
+    }
+
+    // дописывать в старый журнал нельзя: его хвост мог оборваться при сбое
+    log_generation_ = last_generation + 1;
+    log_ = make_shared<WriteAheadLog>(GetLogPath(log_generation_));
+    SyncPath(directory_);
+}
+
+void DurableSearchServer::RemoveFilesBefore(uint64_t generation) const {
+    for (const auto& entry : filesystem::directory_iterator(directory_)) {
+        const string file_name = entry.path().filename().string();
+        const optional<uint64_t> snapshot_generation = ParseGeneration(file_name, "index"sv);
+        const optional<uint64_t> log_generation = ParseGeneration(file_name, "log"sv);
+        if ((snapshot_generation && *snapshot_generation < generation)
+            || (log_generation && *log_generation < generation)) {
+            filesystem::remove(entry.path());
+        }
+    }
+}
+
+string DurableSearchServer::GetSnapshotPath(uint64_t generation) const {
+    return directory_ + "/index."s + to_string(generation);
+}
+
+string DurableSearchServer::GetLogPath(uint64_t generation) const {
+    return directory_ + "/log."s + to_string(generation);
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "search_server.h"
+#include "write_ahead_log.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Поисковый сервер, переживающий перезапуск. Каталог сервера содержит
+// снимки индекса index.N (SearchServer::Save) и журналы изменений log.N
+// (WriteAheadLog). Снимок index.N включает все изменения из журналов с
+// меньшими номерами, поэтому при открытии загружается последний снимок и
+// поверх него воспроизводятся журналы с номерами от N. Изменение
+// применяется к индексу, записывается в журнал и возвращает управление,
+// когда запись оказалась на диске.
+class DurableSearchServer {
+public:
+    // Стоп-слова используются, только если в каталоге ещё нет снимка
+    template <typename StringContainer>
+    DurableSearchServer(const std::string& directory, const StringContainer& stop_words);
+    DurableSearchServer(const std::string& directory, std::string_view stop_words_text);
+    DurableSearchServer(const std::string& directory, const std::string& stop_words_text);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    // Весь пакет фиксируется в журнале одной синхронизацией
+    void AddDocuments(const std::vector<SearchServer::NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    // Удаления пакета тоже фиксируются одной синхронизацией
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Сохраняет снимок индекса и удаляет покрытые им журналы. Изменения на
+    // время сохранения снимка приостанавливаются, запросы — нет
+    void Checkpoint();
+
+    // Аргументы те же, что у SearchServer
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    template <typename... Args>
+    SearchServer::MatchResult MatchDocument(Args&&... args) const;
+
+    int GetDocumentCount() const;
+
+private:
+    std::string directory_;
+    // номер последнего снимка (0, если снимка нет) и текущего журнала
+    std::uint64_t snapshot_generation_;
+    std::uint64_t log_generation_ = 0;
+    SearchServer server_;
+    std::shared_ptr<WriteAheadLog> log_;
+
+    // запросы берут мьютекс на чтение, изменения — монопольно, так что
+    // порядок записей в журнале совпадает с порядком применения
+    mutable std::shared_mutex mutex_;
+    std::mutex checkpoint_mutex_;
+
+    DurableSearchServer(const std::string& directory, SearchServer empty_server);
+
+    void ReplayLogs();
+    void RemoveFilesBefore(std::uint64_t generation) const;
+    std::string GetSnapshotPath(std::uint64_t generation) const;
+    std::string GetLogPath(std::uint64_t generation) const;
+};
+
+template <typename StringContainer>
+DurableSearchServer::DurableSearchServer(const std::string& directory,
+    const StringContainer& stop_words)
+    : DurableSearchServer(directory, SearchServer(stop_words)) {
+}
+
+template <typename... Args>
+std::vector<Document> DurableSearchServer::FindTopDocuments(Args&&... args) const {
+    const std::shared_lock lock(mutex_);
+    return server_.FindTopDocuments(std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+SearchServer::MatchResult DurableSearchServer::MatchDocument(Args&&... args) const {
+    const std::shared_lock lock(mutex_);
+    return server_.MatchDocument(std::forward<Args>(args)...);
+}
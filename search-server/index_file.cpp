@@ -0,0 +1,405 @@
+#include "index_file.h"
+#include "search_server.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace index_file {
+
+uint64_t ComputeChecksum(const char* data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull ^ size;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+} // namespace index_file
+
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open index file "s + path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw runtime_error("Cannot open index file "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+
+    if (size_ > 0) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        throw runtime_error("Cannot map index file "s + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+const char* MappedFile::GetData() const {
+    return static_cast<const char*>(data_);
+}
+
+size_t MappedFile::GetSize() const {
+    return size_;
+}
+
+void MappedFile::AdviseSequential() const {
+    if (data_ != nullptr) {
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+}
+
+void SyncPath(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open "s + path);
+    }
+    const int result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        throw runtime_error("Cannot sync "s + path);
+    }
+}
+
+namespace {
+
+using namespace index_file;
+
+constexpr size_t SECTION_COUNT = static_cast<size_t>(SectionType::COUNT);
+
+size_t AlignUp(size_t size) {
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Пишет разделы по очереди, а заголовок с таблицей разделов — в конце
+class IndexFileWriter {
+public:
+    explicit IndexFileWriter(const string& path)
+        : out_(path, ios::binary | ios::trunc) {
+        if (!out_) {
+            throw runtime_error("Cannot write index file "s + path);
+        }
+        offset_ = AlignUp(sizeof(Header) + sizeof(Section) * SECTION_COUNT);
+        WritePadding(offset_);
+    }
+
+    template <typename T>
+    void WriteSection(SectionType type, const vector<T>& items) {
+        WriteSection(type, reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    }
+
+    void WriteSection(SectionType type, const char* data, size_t size) {
+        sections_[static_cast<size_t>(type)] = {type, 0, offset_, size, ComputeChecksum(data, size)};
+        out_.write(data, static_cast<streamsize>(size));
+        WritePadding(AlignUp(size) - size);
+        offset_ += AlignUp(size);
+    }
+
+    void Finish(uint64_t document_count, uint64_t term_count) {
+        Header header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.section_count = static_cast<uint32_t>(SECTION_COUNT);
+        header.file_size = offset_;
+        header.document_count = document_count;
+        header.term_count = term_count;
+        header.checksum = ComputeHeaderChecksum(header, sections_);
+
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out_.write(reinterpret_cast<const char*>(sections_), sizeof(sections_));
+        out_.flush();
+        if (!out_) {
+            throw runtime_error("Cannot write index file"s);
+        }
+    }
+
+    static uint64_t ComputeHeaderChecksum(Header header, const Section* sections) {
+        header.checksum = 0;
+        vector<char> bytes(sizeof(Header) + sizeof(Section) * SECTION_COUNT);
+        memcpy(bytes.data(), &header, sizeof(Header));
+        memcpy(bytes.data() + sizeof(Header), sections, sizeof(Section) * SECTION_COUNT);
+        return ComputeChecksum(bytes.data(), bytes.size());
+    }
+
+private:
+    ofstream out_;
+    uint64_t offset_ = 0;
+    Section sections_[SECTION_COUNT] = {};
+
+    void WritePadding(size_t size) {
+        static const char zeros[ALIGNMENT] = {};
+        while (size > 0) {
+            const size_t chunk = min(size, ALIGNMENT);
+            out_.write(zeros, static_cast<streamsize>(chunk));
+            size -= chunk;
+        }
+    }
+};
+
+[[noreturn]] void ThrowCorrupted() {
+    throw runtime_error("Index file is corrupted"s);
+}
+
+} // namespace
+
+void SearchServer::Save(const string& path) const {
+    static_assert(sizeof(DocumentTerm) == 2 * sizeof(uint32_t));
+
+    // удалённые документы выбрасываются, остальные нумеруются подряд
+    vector<int> file_ordinals(documents_.size(), -1);
+    int document_count = 0;
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        if (!documents_[ordinal].is_removed) {
+            file_ordinals[ordinal] = document_count++;
+        }
+    }
+
+    const string temporary_path = path + ".tmp"s;
+    IndexFileWriter writer(temporary_path);
+
+    string stop_words;
+    for (const string_view stop_word : stop_words_.GetWords()) {
+        if (!stop_words.empty()) {
+            stop_words += ' ';
+        }
+        stop_words += stop_word;
+    }
+    writer.WriteSection(SectionType::STOP_WORDS, stop_words.data(), stop_words.size());
+
+    vector<uint64_t> term_offsets{0};
+    string term_chars;
+    for (const string_view term : terms_) {
+        term_chars += term;
+        term_offsets.push_back(term_chars.size());
+    }
+    writer.WriteSection(SectionType::TERM_OFFSETS, term_offsets);
+    writer.WriteSection(SectionType::TERM_CHARS, term_chars.data(), term_chars.size());
+    writer.WriteSection(SectionType::DOCUMENT_FREQS, document_freqs_);
+
+    vector<DocumentRecord> document_records;
+    vector<uint64_t> document_term_offsets{0};
+    vector<DocumentTerm> document_terms;
+    for (size_t ordinal = 0; ordinal < documents_.size(); ++ordinal) {
+        const DocumentData& document_data = documents_[ordinal];
+        if (document_data.is_removed) {
+            continue;
+        }
+        document_records.push_back({document_data.id, document_data.rating,
+            static_cast<int32_t>(document_data.status), 0, document_data.inv_word_count});
+        document_terms.insert(document_terms.end(),
+            document_terms_[ordinal].begin(), document_terms_[ordinal].end());
+        document_term_offsets.push_back(document_terms.size());
+    }
+    writer.WriteSection(SectionType::DOCUMENTS, document_records);
+    writer.WriteSection(SectionType::DOCUMENT_TERM_OFFSETS, document_term_offsets);
+    writer.WriteSection(SectionType::DOCUMENT_TERMS, document_terms);
+
+    // постинги всех сегментов каждого слова сливаются в один список
+    // с новыми номерами документов
+    vector<PostingListRecord> posting_lists;
+    vector<PostingList::Block> blocks;
+    vector<uint32_t> data;
+    vector<uint32_t> tail_ids;
+    vector<uint32_t> tail_counts;
+    for (TermId term_id = 0; term_id < terms_.size(); ++term_id) {
+        PostingList postings;
+        ForEachSegment([&](const IndexSegment& segment) {
+            const PostingList* segment_postings = segment.FindPostings(term_id);
+            if (segment_postings == nullptr) {
+                return;
+            }
+            segment_postings->ForEach([&](int ordinal, uint32_t count) {
+                if (file_ordinals[ordinal] >= 0) {
+                    postings.Insert(file_ordinals[ordinal], count,
+                        count * documents_[ordinal].inv_word_count);
+                }
+            });
+        });
+
+        const PostingList::View view = postings.GetView();
+        posting_lists.push_back({blocks.size(), data.size(), tail_ids.size(),
+            static_cast<uint32_t>(view.block_count), static_cast<uint32_t>(view.data_size),
+            static_cast<uint32_t>(view.tail_size), static_cast<uint32_t>(view.size),
+            view.max_term_freq, view.tail_max_term_freq});
+        blocks.insert(blocks.end(), view.blocks, view.blocks + view.block_count);
+        data.insert(data.end(), view.data, view.data + view.data_size);
+        tail_ids.insert(tail_ids.end(), view.tail_ids, view.tail_ids + view.tail_size);
+        tail_counts.insert(tail_counts.end(), view.tail_counts, view.tail_counts + view.tail_size);
+    }
+    writer.WriteSection(SectionType::POSTING_LISTS, posting_lists);
+    writer.WriteSection(SectionType::POSTING_BLOCKS, blocks);
+    writer.WriteSection(SectionType::POSTING_DATA, data);
+    writer.WriteSection(SectionType::POSTING_TAIL_IDS, tail_ids);
+    writer.WriteSection(SectionType::POSTING_TAIL_COUNTS, tail_counts);
+
+    writer.Finish(document_count, terms_.size());
+    SyncPath(temporary_path);
+    if (rename(temporary_path.c_str(), path.c_str()) != 0) {
+        throw runtime_error("Cannot write index file "s + path);
+    }
+}
+
+SearchServer SearchServer::Open(const string& path, bool verify_checksums) {
+    auto file = make_shared<const MappedFile>(path);
+    const char* file_data = file->GetData();
+    const size_t file_size = file->GetSize();
+
+    if (file_size < sizeof(Header) + sizeof(Section) * SECTION_COUNT) {
+        ThrowCorrupted();
+    }
+    Header header;
+    memcpy(&header, file_data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw runtime_error("Not an index file "s + path);
+    }
+    if (header.version != VERSION) {
+        throw runtime_error("Unsupported index file version "s + to_string(header.version));
+    }
+    if (header.section_count != SECTION_COUNT || header.file_size != file_size) {
+        ThrowCorrupted();
+    }
+    Section sections[SECTION_COUNT];
+    memcpy(sections, file_data + sizeof(Header), sizeof(sections));
+    if (IndexFileWriter::ComputeHeaderChecksum(header, sections) != header.checksum) {
+        ThrowCorrupted();
+    }
+    for (size_t i = 0; i < SECTION_COUNT; ++i) {
+        const Section& section = sections[i];
+        if (static_cast<size_t>(section.type) != i || section.offset % ALIGNMENT != 0
+            || section.offset > file_size || section.size > file_size - section.offset) {
+            ThrowCorrupted();
+        }
+        if (verify_checksums
+            && ComputeChecksum(file_data + section.offset, section.size) != section.checksum) {
+            ThrowCorrupted();
+        }
+    }
+
+    // массив раздела с проверкой, что в разделе хватает места
+    const auto get_array = [&](SectionType type, auto* type_tag, size_t count) {
+        using T = remove_pointer_t<decltype(type_tag)>;
+        const Section& section = sections[static_cast<size_t>(type)];
+        if (section.size < count * sizeof(T)) {
+            ThrowCorrupted();
+        }
+        return reinterpret_cast<const T*>(file_data + section.offset);
+    };
+    const auto get_size = [&](SectionType type) {
+        return sections[static_cast<size_t>(type)].size;
+    };
+
+    const size_t term_count = header.term_count;
+    const size_t document_count = header.document_count;
+
+    SearchServer search_server(string_view(get_array(SectionType::STOP_WORDS, (char*)nullptr, 0),
+        get_size(SectionType::STOP_WORDS)));
+
+    const uint64_t* term_offsets = get_array(SectionType::TERM_OFFSETS, (uint64_t*)nullptr, term_count + 1);
+    const char* term_chars = get_array(SectionType::TERM_CHARS, (char*)nullptr, term_offsets[term_count]);
+    const uint32_t* document_freqs = get_array(SectionType::DOCUMENT_FREQS, (uint32_t*)nullptr, term_count);
+    search_server.terms_.reserve(term_count);
+    search_server.term_ids_.reserve(term_count);
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        if (term_offsets[term_id] > term_offsets[term_id + 1]) {
+            ThrowCorrupted();
+        }
+        const string_view term(term_chars + term_offsets[term_id],
+            term_offsets[term_id + 1] - term_offsets[term_id]);
+        search_server.terms_.push_back(term);
+        search_server.term_ids_.emplace(term, static_cast<TermId>(term_id));
+    }
+    search_server.document_freqs_.assign(document_freqs, document_freqs + term_count);
+
+    const DocumentRecord* document_records =
+        get_array(SectionType::DOCUMENTS, (DocumentRecord*)nullptr, document_count);
+    const uint64_t* document_term_offsets =
+        get_array(SectionType::DOCUMENT_TERM_OFFSETS, (uint64_t*)nullptr, document_count + 1);
+    const DocumentTerm* document_terms = get_array(SectionType::DOCUMENT_TERMS,
+        (DocumentTerm*)nullptr, document_term_offsets[document_count]);
+    search_server.documents_.reserve(document_count);
+    search_server.document_terms_.reserve(document_count);
+    for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+        const DocumentRecord& record = document_records[ordinal];
+        if (document_term_offsets[ordinal] > document_term_offsets[ordinal + 1]
+            || !search_server.document_ordinals_.emplace(record.id, static_cast<int>(ordinal)).second) {
+            ThrowCorrupted();
+        }
+        search_server.documents_.push_back(DocumentData{record.id, record.rating,
+            static_cast<DocumentStatus>(record.status), record.inv_word_count});
+        search_server.document_terms_.push_back({document_terms + document_term_offsets[ordinal],
+            document_terms + document_term_offsets[ordinal + 1]});
+        search_server.document_ids_.insert(record.id);
+    }
+    search_server.document_term_storage_.resize(document_count);
+    search_server.word_frequencies_.resize(document_count);
+
+    const PostingListRecord* posting_lists =
+        get_array(SectionType::POSTING_LISTS, (PostingListRecord*)nullptr, term_count);
+    const size_t block_count = get_size(SectionType::POSTING_BLOCKS) / sizeof(PostingList::Block);
+    const size_t data_size = get_size(SectionType::POSTING_DATA) / sizeof(uint32_t);
+    const size_t tail_size = get_size(SectionType::POSTING_TAIL_IDS) / sizeof(uint32_t);
+    const auto* blocks = get_array(SectionType::POSTING_BLOCKS, (PostingList::Block*)nullptr, block_count);
+    const uint32_t* data = get_array(SectionType::POSTING_DATA, (uint32_t*)nullptr, data_size);
+    const uint32_t* tail_ids = get_array(SectionType::POSTING_TAIL_IDS, (uint32_t*)nullptr, tail_size);
+    const uint32_t* tail_counts = get_array(SectionType::POSTING_TAIL_COUNTS, (uint32_t*)nullptr, tail_size);
+
+    IndexSegment segment(0);
+    for (size_t term_id = 0; term_id < term_count; ++term_id) {
+        const PostingListRecord& record = posting_lists[term_id];
+        if (record.size == 0) {
+            continue;
+        }
+        if (record.first_block + record.block_count > block_count
+            || record.first_data_word + record.data_size > data_size
+            || record.first_tail_entry + record.tail_size > tail_size) {
+            ThrowCorrupted();
+        }
+        PostingList::View view;
+        view.blocks = blocks + record.first_block;
+        view.block_count = record.block_count;
+        view.data = data + record.first_data_word;
+        view.data_size = record.data_size;
+        view.tail_ids = tail_ids + record.first_tail_entry;
+        view.tail_counts = tail_counts + record.first_tail_entry;
+        view.tail_size = record.tail_size;
+        view.tail_max_term_freq = record.tail_max_term_freq;
+        view.max_term_freq = record.max_term_freq;
+        view.size = record.size;
+        segment.AddPostingList(static_cast<TermId>(term_id), PostingList(view));
+    }
+    segment.ExtendTo(static_cast<int>(document_count));
+    segment.SetStorage(file);
+
+    search_server.sealed_segments_.push_back({make_shared<const IndexSegment>(move(segment)),
+        static_cast<int>(document_count), 0});
+    search_server.active_segment_ = IndexSegment(static_cast<int>(document_count));
+    search_server.mapped_file_ = move(file);
+    return search_server;
+}
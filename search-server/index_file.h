@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Формат файла индекса (SearchServer::Save, SearchServer::Open).
+// Файл состоит из заголовка, таблицы разделов и самих разделов, каждый из
+// которых выровнен на 64 байта. Числа записываются в порядке байт машины,
+// записавшей файл. Массивы разделов читаются прямо из отображённого в память
+// файла, поэтому их элементы хранятся в том же виде, что и в памяти.
+namespace index_file {
+
+constexpr char MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+constexpr std::uint32_t VERSION = 1;
+constexpr size_t ALIGNMENT = 64;
+
+enum class SectionType : std::uint32_t {
+    // стоп-слова через пробел
+    STOP_WORDS,
+    // слова словаря: смещения uint64_t[term_count + 1] в TERM_CHARS
+    TERM_OFFSETS,
+    TERM_CHARS,
+    // uint32_t[term_count]
+    DOCUMENT_FREQS,
+    // DocumentRecord[document_count]
+    DOCUMENTS,
+    // прямой индекс: смещения uint64_t[document_count + 1] в DOCUMENT_TERMS
+    DOCUMENT_TERM_OFFSETS,
+    // пары (номер слова, число вхождений) по возрастанию номера слова
+    DOCUMENT_TERMS,
+    // PostingListRecord[term_count]
+    POSTING_LISTS,
+    // PostingList::Block всех списков подряд
+    POSTING_BLOCKS,
+    // сжатые данные блоков
+    POSTING_DATA,
+    // неполные хвосты списков: id и счётчики
+    POSTING_TAIL_IDS,
+    POSTING_TAIL_COUNTS,
+    COUNT,
+};
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t section_count;
+    std::uint64_t file_size;
+    std::uint64_t document_count;
+    std::uint64_t term_count;
+    // сумма заголовка (с нулём в этом поле) и таблицы разделов
+    std::uint64_t checksum;
+};
+
+struct Section {
+    SectionType type;
+    std::uint32_t reserved;
+    std::uint64_t offset;
+    std::uint64_t size;
+    std::uint64_t checksum;
+};
+
+struct DocumentRecord {
+    std::int32_t id;
+    std::int32_t rating;
+    std::int32_t status;
+    std::uint32_t reserved;
+    double inv_word_count;
+};
+
+// Положение списка слова в разделах POSTING_*; номера — в элементах
+struct PostingListRecord {
+    std::uint64_t first_block;
+    std::uint64_t first_data_word;
+    std::uint64_t first_tail_entry;
+    std::uint32_t block_count;
+    std::uint32_t data_size;
+    std::uint32_t tail_size;
+    std::uint32_t size;
+    float max_term_freq;
+    float tail_max_term_freq;
+};
+
+// Контрольная сумма для обнаружения повреждений (не криптографическая)
+std::uint64_t ComputeChecksum(const char* data, size_t size);
+
+} // namespace index_file
+
+// Файл, отображённый в память только для чтения
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* GetData() const;
+    size_t GetSize() const;
+    // Подсказывает ядру, что файл будет читаться по порядку, чтобы оно
+    // читало его заранее и большими порциями
+    void AdviseSequential() const;
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Сбрасывает на диск содержимое файла или каталога (в том числе записи
+// о созданных и переименованных в нём файлах)
+void SyncPath(const std::string& path);
@@ -0,0 +1,93 @@
+#include "index_segment.h"
+
+using namespace std;
+
+IndexSegment::IndexSegment(int first_ordinal)
+    : first_ordinal_(first_ordinal)
+    , end_ordinal_(first_ordinal) {
+}
+
+void IndexSegment::AddPosting(TermId term_id, int ordinal, uint32_t count, double term_freq) {
+    postings_[term_id].Insert(ordinal, count, term_freq);
+    ++posting_count_;
+}
+
+void IndexSegment::ExtendTo(int end_ordinal) {
+    end_ordinal_ = max(end_ordinal_, end_ordinal);
+}
+
+PostingList& IndexSegment::GetPostingsForUpdate(TermId term_id) {
+    return postings_[term_id];
+}
+
+void IndexSegment::AddPostingCount(size_t count) {
+    posting_count_ += count;
+}
+
+void IndexSegment::AddPostingList(TermId term_id, PostingList postings) {
+    posting_count_ += postings.Size();
+    postings_.emplace(term_id, move(postings));
+}
+
+void IndexSegment::ErasePostings(TermId term_id) {
+    const auto it = postings_.find(term_id);
+    if (it == postings_.end()) {
+        return;
+    }
+
+    posting_count_ -= it->second.Size();
+    postings_.erase(it);
+}
+
+void IndexSegment::SetStorage(shared_ptr<const void> storage) {
+    storage_ = move(storage);
+}
+
+int IndexSegment::GetFirstOrdinal() const {
+    return first_ordinal_;
+}
+
+int IndexSegment::GetEndOrdinal() const {
+    return end_ordinal_;
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term_id) const {
+    const auto it = postings_.find(term_id);
+    if (it == postings_.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+IndexSegment IndexSegment::Merge(const vector<const IndexSegment*>& segments,
+    const vector<bool>& is_removed, const vector<double>& inv_word_counts) {
+
+    IndexSegment result(segments.front()->first_ordinal_);
+    result.ExtendTo(segments.back()->end_ordinal_);
+
+    // сегменты идут по возрастанию номеров, поэтому записи каждого слова
+    // дописываются в конец его постингов
+    for (const IndexSegment* segment : segments) {
+        for (const auto& [term_id, postings] : segment->postings_) {
+            PostingList* merged_postings = nullptr;
+            postings.ForEach([&](int ordinal, uint32_t count) {
+                const size_t offset = static_cast<size_t>(ordinal - result.first_ordinal_);
+                if (is_removed[offset]) {
+                    return;
+                }
+                if (merged_postings == nullptr) {
+                    merged_postings = &result.postings_[term_id];
+                }
+                merged_postings->Insert(ordinal, count, count * inv_word_counts[offset]);
+                ++result.posting_count_;
+            });
+        }
+    }
+
+    return result;
+}
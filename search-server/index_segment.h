@@ -0,0 +1,56 @@
+#pragma once
+#include "postings.h"
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Сегмент индекса: постинги слов для документов с порядковыми номерами из
+// [first_ordinal, end_ordinal). Пополняется только активный сегмент сервера;
+// запечатанные сегменты не меняются, поэтому их можно читать из фонового
+// слияния без синхронизации с добавлением документов.
+class IndexSegment {
+public:
+    using TermId = std::uint32_t;
+
+    explicit IndexSegment(int first_ordinal);
+
+    // Записи добавляются в порядке возрастания номеров документов
+    void AddPosting(TermId term_id, int ordinal, std::uint32_t count, double term_freq);
+    // Расширяет диапазон сегмента до end_ordinal (не включая), в том числе
+    // на документы без слов
+    void ExtendTo(int end_ordinal);
+    // Постинги слова для пополнения в обход AddPosting, в том числе из разных
+    // потоков для разных слов; число добавленных так записей учитывается
+    // AddPostingCount
+    PostingList& GetPostingsForUpdate(TermId term_id);
+    void AddPostingCount(size_t count);
+    // Добавляет готовый список слова, которого в сегменте ещё нет
+    void AddPostingList(TermId term_id, PostingList postings);
+    // Выбрасывает постинги слова; сегмент не должны читать другие потоки
+    void ErasePostings(TermId term_id);
+    // Память, из которой читают списки-представления (см. PostingList::View),
+    // живёт не меньше сегмента
+    void SetStorage(std::shared_ptr<const void> storage);
+
+    int GetFirstOrdinal() const;
+    int GetEndOrdinal() const;
+    size_t GetPostingCount() const;
+
+    // nullptr, если слова в сегменте нет
+    const PostingList* FindPostings(TermId term_id) const;
+
+    // Сливает идущие подряд сегменты в один, отбрасывая записи удалённых
+    // документов. is_removed и inv_word_counts индексируются номером
+    // документа за вычетом первого номера первого сегмента
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments,
+        const std::vector<bool>& is_removed, const std::vector<double>& inv_word_counts);
+
+private:
+    int first_ordinal_;
+    int end_ordinal_;
+    size_t posting_count_ = 0;
+    std::unordered_map<TermId, PostingList> postings_;
+    std::shared_ptr<const void> storage_;
+};
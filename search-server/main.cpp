@@ -1,11 +1,18 @@
+#include "concurrent_map.h"
+#include "postings.h"
 #include "process_queries.h"
+#include "request_queue.h"
 #include "search_server.h"
 
 #include "log_duration.h"
 
+#include <cmath>
 #include <execution>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <random>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -54,6 +61,38 @@ vector<string> GenerateQueries(mt19937& generator, const vector<string>& diction
     return queries;
 }
 
+// Скалярная распаковка постингов должна давать то же, что и SSE2-ядро,
+// при любой ширине упаковки id и счётчиков
+void TestPostingDecoding() {
+    mt19937 generator;
+    PostingList postings;
+    vector<pair<int, uint32_t>> expected;
+    int document_id = 0;
+    for (int i = 0; i < 20'000; ++i) {
+        // шаг и счётчик растут по ходу списка, чтобы блоки получили разную ширину
+        const int max_bits = 1 + i / 1'000;
+        document_id += uniform_int_distribution(1, 1 << min(max_bits, 16))(generator);
+        const uint32_t count = uniform_int_distribution<uint32_t>(1, 1u << max_bits)(generator);
+        postings.Insert(document_id, count, 0.0);
+        expected.emplace_back(document_id, count);
+    }
+
+    const auto decode = [&postings] {
+        vector<pair<int, uint32_t>> result;
+        postings.ForEach([&result](int document_id, uint32_t count) {
+            result.emplace_back(document_id, count);
+        });
+        return result;
+    };
+    const auto vectorized = decode();
+    PostingList::ForceScalarDecoding(true);
+    const auto scalar = decode();
+    PostingList::ForceScalarDecoding(false);
+    if (vectorized != expected || scalar != expected) {
+        throw logic_error("posting kernels decode differently"s);
+    }
+}
+
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
     LOG_DURATION(mark);
@@ -68,19 +107,189 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
 
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
+template <typename ProcessFunction>
+void TestProcessQueries(string_view mark, const SearchServer& search_server, 
+    const vector<string>& queries, ProcessFunction process) {
+    
+    LOG_DURATION(mark);
+    double total_relevance = 0;
+    for (const auto& documents : process(search_server, queries)) {
+        for (const auto& document : documents) {
+            total_relevance += document.relevance;
+        }
+    }
+    cout << total_relevance << endl;
+}
+
+// Прежняя реализация ConcurrentMap для сравнения: std::map в каждом бакете
+// под мьютексом, бакеты без выравнивания по кэш-линии
+template <typename Key, typename Value>
+class BucketMapConcurrentMap {
+public:
+    struct Bucket {
+        map<Key, Value> bucket_map;
+        mutex m;
+    };
+
+    struct Access {
+        lock_guard<mutex> guard;
+        Value& ref_to_value;
+
+        Access(map<Key, Value>& bucket, mutex& m, const Key& key)
+            : guard(m), ref_to_value(bucket[key]) {
+        }
+    };
+
+    explicit BucketMapConcurrentMap(size_t bucket_count)
+        : buckets_(bucket_count) {
+    }
+
+    Access operator[](const Key& key) {
+        Bucket& bucket = buckets_[static_cast<size_t>(key) % buckets_.size()];
+        return {bucket.bucket_map, bucket.m, key};
+    }
+
+    map<Key, Value> BuildOrdinaryMap() {
+        map<Key, Value> res;
+        for (Bucket& bucket : buckets_) {
+            lock_guard guard(bucket.m);
+            res.insert(bucket.bucket_map.begin(), bucket.bucket_map.end());
+        }
+        return res;
+    }
+
+private:
+    vector<Bucket> buckets_;
+};
+
+// Ключи с перекосом: малые значения встречаются гораздо чаще, как номера
+// документов с частыми словами
+vector<int> GenerateKeys(mt19937& generator, int key_count, int max_key) {
+    vector<int> keys;
+    keys.reserve(key_count);
+    for (int i = 0; i < key_count; ++i) {
+        const double x = uniform_real_distribution<>(0, 1)(generator);
+        keys.push_back(static_cast<int>(max_key * pow(x, 3)));
+    }
+    return keys;
+}
+
+template <typename ConcurrentMapType>
+void TestConcurrentMap(string_view mark, const vector<int>& keys) {
+    LOG_DURATION(mark);
+    ConcurrentMapType document_to_relevance(100);
+    for_each(execution::par, keys.begin(), keys.end(), 
+        [&document_to_relevance](int key) {
+            document_to_relevance[key].ref_to_value += 1.0;
+        }
+    );
+    cout << document_to_relevance.BuildOrdinaryMap().size() << endl;
+}
+
+// Прежний разбор текста для сравнения: поиск пробелов через find по одному
+// слову и отдельная проверка каждого слова на управляющие символы
+bool SplitIntoWordsByFind(string_view text, vector<string_view>& words) {
+    words.clear();
+    while (true) {
+        const size_t space = text.find(' ');
+        const string_view word = text.substr(0, space);
+        if (!word.empty()) {
+            words.push_back(word);
+        }
+        if (space == text.npos) {
+            break;
+        }
+        text.remove_prefix(space + 1);
+    }
+    return all_of(words.begin(), words.end(), [](string_view word) {
+        return none_of(word.begin(), word.end(), [](char c) {
+            return c >= '\0' && c < ' ';
+        });
+    });
+}
+
+template <typename SplitFunction>
+void TestSplit(string_view mark, const vector<string>& texts, SplitFunction split) {
+    LOG_DURATION(mark);
+    vector<string_view> words;
+    size_t word_count = 0;
+    for (int repeat = 0; repeat < 10; ++repeat) {
+        for (const string& text : texts) {
+            if (split(text, words)) {
+                word_count += words.size();
+            }
+        }
+    }
+    cout << word_count << endl;
+}
+
+template <typename RequestQueueType, typename ExecutionPolicy>
+void TestRequestQueue(string_view mark, const SearchServer& search_server, 
+    const vector<string>& queries, ExecutionPolicy&& policy) {
+    
+    LOG_DURATION(mark);
+    RequestQueueType request_queue(search_server);
+    for_each(policy, queries.begin(), queries.end(), 
+        [&request_queue](const string& query) {
+            request_queue.AddFindRequest(query);
+        }
+    );
+    cout << request_queue.GetNoResultRequests() << endl;
+}
+
 int main() {
     mt19937 generator;
 
+    TestPostingDecoding();
+
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
 
     SearchServer search_server(dictionary[0]);
+    vector<SearchServer::NewDocument> new_documents;
     for (size_t i = 0; i < documents.size(); ++i) {
-        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, {1, 2, 3});
+        new_documents.push_back({static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {1, 2, 3}});
     }
+    search_server.AddDocuments(new_documents);
 
     const auto queries = GenerateQueries(generator, dictionary, 100, 70);
 
     TEST(seq);
     TEST(par);
+
+    // короткие запросы по общему словарю часто делят слова
+    const auto batch_queries = GenerateQueries(generator, dictionary, 2'000, 5);
+    TestProcessQueries("process queries", search_server, batch_queries, ProcessQueries);
+
+    // около 40% запросов — повторы запросов из небольшого набора
+    const auto popular_queries = GenerateQueries(generator, dictionary, 100, 5);
+    vector<string> repeated_queries;
+    for (int i = 0; i < 5'000; ++i) {
+        repeated_queries.push_back(uniform_int_distribution(0, 9)(generator) < 4
+            ? popular_queries[uniform_int_distribution<size_t>(0, popular_queries.size() - 1)(generator)]
+            : GenerateQuery(generator, dictionary, 5));
+    }
+    Test("without result cache", search_server, repeated_queries, execution::seq);
+    search_server.SetResultCacheCapacity(16 << 20);
+    Test("with result cache", search_server, repeated_queries, execution::seq);
+    const auto cache_stats = search_server.GetResultCacheStats();
+    cout << "hits: "s << cache_stats.hits << ", misses: "s << cache_stats.misses << endl;
+    search_server.SetResultCacheCapacity(0);
+
+    // в половине запросов нет слов документов
+    const auto other_dictionary = GenerateDictionary(generator, 1000, 10);
+    vector<string> logged_queries;
+    for (int i = 0; i < 50'000; ++i) {
+        logged_queries.push_back(GenerateQuery(generator, i % 2 == 0 ? dictionary : other_dictionary, 3));
+    }
+    TestRequestQueue<RequestQueue>("request queue seq", search_server, logged_queries, execution::seq);
+    TestRequestQueue<RequestQueue>("request queue par", search_server, logged_queries, execution::par);
+
+    const auto long_documents = GenerateQueries(generator, dictionary, 1'000, 5'000);
+    TestSplit("split by find", long_documents, SplitIntoWordsByFind);
+    TestSplit("split vectorized", long_documents, SplitIntoValidWords);
+
+    const auto keys = GenerateKeys(generator, 1'000'000, 100'000);
+    TestConcurrentMap<BucketMapConcurrentMap<int, double>>("bucket map", keys);
+    TestConcurrentMap<ConcurrentMap<int, double>>("striped open addressing", keys);
 } 
\ No newline at end of file
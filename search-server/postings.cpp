@@ -0,0 +1,472 @@
+#include "postings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define POSTINGS_HAS_SSE2_KERNEL
+#endif
+
+using namespace std;
+
+namespace {
+
+constexpr size_t LANES = 4;
+constexpr size_t VALUES_PER_LANE = PostingList::BLOCK_SIZE / LANES;
+
+int BitWidth(uint32_t value) {
+    int bits = 0;
+    while (value != 0) {
+        ++bits;
+        value >>= 1;
+    }
+    return bits;
+}
+
+// Значение i попадает в линию i % 4, k-е слово линии L лежит в out[4 * k + L].
+// Всего занимает bits * 4 слов.
+void Pack(const uint32_t* in, int bits, uint32_t* out) {
+    if (bits == 0) {
+        return;
+    }
+
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        uint32_t word = 0;
+        int shift = 0;
+        size_t k = 0;
+
+        for (size_t j = 0; j < VALUES_PER_LANE; ++j) {
+            const uint32_t value = in[LANES * j + lane];
+            word |= value << shift;
+            shift += bits;
+            if (shift >= 32) {
+                out[LANES * k + lane] = word;
+                ++k;
+                shift -= 32;
+                word = shift > 0 ? value >> (bits - shift) : 0;
+            }
+        }
+    }
+}
+
+// Распаковка с восстановлением значений из дельт с шагом 4:
+// out[i] = out[i - 4] + delta[i], для первых четырёх база — base.
+void UnpackScalar(const uint32_t* in, int bits, uint32_t base, bool prefix_sum, uint32_t* out) {
+    const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+
+    for (size_t lane = 0; lane < LANES; ++lane) {
+        uint32_t running = prefix_sum ? base : 0;
+
+        if (bits == 0) {
+            for (size_t j = 0; j < VALUES_PER_LANE; ++j) {
+                out[LANES * j + lane] = running;
+            }
+            continue;
+        }
+
+        const uint32_t* word = in + lane;
+        int shift = 0;
+
+        for (size_t j = 0; j < VALUES_PER_LANE; ++j) {
+            uint32_t value = *word >> shift;
+            shift += bits;
+            if (shift >= 32) {
+                shift -= 32;
+                if (j + 1 != VALUES_PER_LANE) {
+                    word += LANES;
+                    if (shift > 0) {
+                        value |= *word << (bits - shift);
+                    }
+                }
+            }
+            value &= mask;
+
+            if (prefix_sum) {
+                running += value;
+                value = running;
+            }
+            out[LANES * j + lane] = value;
+        }
+    }
+}
+
+#ifdef POSTINGS_HAS_SSE2_KERNEL
+__attribute__((target("sse2")))
+void UnpackSse2(const uint32_t* in, int bits, uint32_t base, bool prefix_sum, uint32_t* out) {
+    __m128i running = _mm_set1_epi32(prefix_sum ? static_cast<int>(base) : 0);
+    __m128i* dst = reinterpret_cast<__m128i*>(out);
+
+    if (bits == 0) {
+        for (size_t j = 0; j < VALUES_PER_LANE; ++j) {
+            _mm_storeu_si128(dst + j, running);
+        }
+        return;
+    }
+
+    const __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+    const __m128i* src = reinterpret_cast<const __m128i*>(in);
+    __m128i word = _mm_loadu_si128(src++);
+    int shift = 0;
+
+    for (size_t j = 0; j < VALUES_PER_LANE; ++j) {
+        __m128i value = _mm_srl_epi32(word, _mm_cvtsi32_si128(shift));
+        shift += bits;
+        if (shift >= 32) {
+            shift -= 32;
+            if (j + 1 != VALUES_PER_LANE) {
+                word = _mm_loadu_si128(src++);
+                if (shift > 0) {
+                    value = _mm_or_si128(value, _mm_sll_epi32(word, _mm_cvtsi32_si128(bits - shift)));
+                }
+            }
+        }
+        value = _mm_and_si128(value, mask);
+
+        if (prefix_sum) {
+            running = _mm_add_epi32(running, value);
+            value = running;
+        }
+        _mm_storeu_si128(dst + j, value);
+    }
+}
+#endif
+
+using UnpackKernel = void (*)(const uint32_t*, int, uint32_t, bool, uint32_t*);
+
+UnpackKernel SelectUnpackKernel() {
+#ifdef POSTINGS_HAS_SSE2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        return UnpackSse2;
+    }
+#endif
+    return UnpackScalar;
+}
+
+UnpackKernel unpack_kernel = SelectUnpackKernel();
+
+// Оценки хранятся во float с округлением вверх, чтобы оставаться верхними
+float RoundUp(double value) {
+    float result = static_cast<float>(value);
+    if (result < value) {
+        result = nextafter(result, numeric_limits<float>::infinity());
+    }
+    return result;
+}
+
+} // namespace
+
+PostingList::PostingList(const View& view)
+    : tail_max_term_freq_(view.tail_max_term_freq)
+    , max_term_freq_(view.max_term_freq)
+    , size_(view.size)
+    , is_view_(true)
+    , view_(view) {
+}
+
+void PostingList::Insert(int document_id, uint32_t count, double term_freq) {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+    const float term_freq_bound = RoundUp(term_freq);
+    max_term_freq_ = max(max_term_freq_, term_freq_bound);
+    ++size_;
+
+    if (blocks_.empty() || blocks_.back().last_document_id < id) {
+        // id обычно добавляются по возрастанию, тогда вставка сводится к push_back
+        const auto it = lower_bound(tail_ids_.begin(), tail_ids_.end(), id);
+        const auto pos = it - tail_ids_.begin();
+        tail_ids_.insert(it, id);
+        tail_counts_.insert(tail_counts_.begin() + pos, count);
+        tail_max_term_freq_ = max(tail_max_term_freq_, term_freq_bound);
+
+        if (tail_ids_.size() == BLOCK_SIZE) {
+            SealTail();
+        }
+        return;
+    }
+
+    const auto it = lower_bound(blocks_.begin(), blocks_.end(), id,
+        [](const Block& block, uint32_t id) {
+            return block.last_document_id < id;
+        }
+    );
+    InsertIntoBlock(it - blocks_.begin(), id, count, term_freq_bound);
+}
+
+void PostingList::Erase(int document_id) {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+
+    if (blocks_.empty() || blocks_.back().last_document_id < id) {
+        const auto it = lower_bound(tail_ids_.begin(), tail_ids_.end(), id);
+        if (it == tail_ids_.end() || *it != id) {
+            return;
+        }
+        tail_counts_.erase(tail_counts_.begin() + (it - tail_ids_.begin()));
+        tail_ids_.erase(it);
+        --size_;
+        return;
+    }
+
+    const auto block_it = lower_bound(blocks_.begin(), blocks_.end(), id,
+        [](const Block& block, uint32_t id) {
+            return block.last_document_id < id;
+        }
+    );
+    if (block_it->first_document_id > id) {
+        return;
+    }
+
+    alignas(16) uint32_t document_ids[BLOCK_SIZE];
+    alignas(16) uint32_t counts[BLOCK_SIZE];
+    DecodeBlock(*block_it, data_.data(), document_ids, counts);
+
+    const size_t block_size = block_it->size;
+    const auto pos = lower_bound(document_ids, document_ids + block_size, id) - document_ids;
+    if (document_ids[pos] != id) {
+        return;
+    }
+
+    copy(document_ids + pos + 1, document_ids + block_size, document_ids + pos);
+    copy(counts + pos + 1, counts + block_size, counts + pos);
+    --size_;
+
+    const size_t block_index = block_it - blocks_.begin();
+    if (block_size == 1) {
+        garbage_size_ += LANES * (block_it->id_bits + block_it->count_bits);
+        blocks_.erase(block_it);
+        CollectGarbage();
+    } else {
+        ReplaceBlock(block_index, document_ids, counts, block_size - 1, block_it->max_term_freq);
+    }
+}
+
+size_t PostingList::Size() const {
+    return size_;
+}
+
+bool PostingList::Empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+PostingList::View PostingList::GetView() const {
+    if (is_view_) {
+        return view_;
+    }
+
+    return {blocks_.data(), blocks_.size(), data_.data(), data_.size(),
+        tail_ids_.data(), tail_counts_.data(), tail_ids_.size(),
+        tail_max_term_freq_, max_term_freq_, size_};
+}
+
+PostingList::Block PostingList::EncodeBlock(const uint32_t* document_ids,
+    const uint32_t* counts, size_t size, float max_term_freq) {
+
+    Block block;
+    block.max_term_freq = max_term_freq;
+    block.first_document_id = document_ids[0];
+    block.last_document_id = document_ids[size - 1];
+    block.size = static_cast<uint8_t>(size);
+
+    // неполный блок дополняется последним id и нулевыми счётчиками,
+    // чтобы распаковка всегда шла по BLOCK_SIZE значений
+    uint32_t deltas[BLOCK_SIZE];
+    uint32_t padded_counts[BLOCK_SIZE];
+    uint32_t max_delta = 0;
+    uint32_t max_count = 0;
+
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+        const uint32_t id = i < size ? document_ids[i] : block.last_document_id;
+        const uint32_t prev = i < LANES ? block.first_document_id
+            : (i - LANES < size ? document_ids[i - LANES] : block.last_document_id);
+        deltas[i] = id - prev;
+        padded_counts[i] = i < size ? counts[i] : 0;
+        max_delta = max(max_delta, deltas[i]);
+        max_count = max(max_count, padded_counts[i]);
+    }
+
+    block.id_bits = static_cast<uint8_t>(BitWidth(max_delta));
+    block.count_bits = static_cast<uint8_t>(BitWidth(max_count));
+    block.data_offset = static_cast<uint32_t>(data_.size());
+    data_.resize(data_.size() + LANES * (block.id_bits + block.count_bits));
+    Pack(deltas, block.id_bits, data_.data() + block.data_offset);
+    Pack(padded_counts, block.count_bits, data_.data() + block.data_offset + LANES * block.id_bits);
+
+    return block;
+}
+
+void PostingList::ReplaceBlock(size_t block_index, const uint32_t* document_ids,
+    const uint32_t* counts, size_t size, float max_term_freq) {
+
+    garbage_size_ += LANES * (blocks_[block_index].id_bits + blocks_[block_index].count_bits);
+    blocks_[block_index] = EncodeBlock(document_ids, counts, size, max_term_freq);
+    CollectGarbage();
+}
+
+void PostingList::CollectGarbage() {
+    if (garbage_size_ * 2 <= data_.size()) {
+        return;
+    }
+
+    vector<uint32_t> data;
+    data.reserve(data_.size() - garbage_size_);
+    for (Block& block : blocks_) {
+        const size_t block_data_size = LANES * (block.id_bits + block.count_bits);
+        const auto first = data_.begin() + block.data_offset;
+        block.data_offset = static_cast<uint32_t>(data.size());
+        data.insert(data.end(), first, first + block_data_size);
+    }
+    data_ = move(data);
+    garbage_size_ = 0;
+}
+
+void PostingList::ForceScalarDecoding(bool force) {
+    unpack_kernel = force ? UnpackScalar : SelectUnpackKernel();
+}
+
+void PostingList::DecodeBlock(const Block& block, const uint32_t* data,
+    uint32_t* document_ids, uint32_t* counts) {
+
+    const uint32_t* block_data = data + block.data_offset;
+    unpack_kernel(block_data, block.id_bits, block.first_document_id, true, document_ids);
+    unpack_kernel(block_data + LANES * block.id_bits, block.count_bits, 0, false, counts);
+}
+
+void PostingList::InsertIntoBlock(size_t block_index, uint32_t document_id, uint32_t count,
+    float term_freq) {
+    
+    alignas(16) uint32_t document_ids[BLOCK_SIZE + 1];
+    alignas(16) uint32_t counts[BLOCK_SIZE + 1];
+    DecodeBlock(blocks_[block_index], data_.data(), document_ids, counts);
+
+    const size_t block_size = blocks_[block_index].size;
+    const float max_term_freq = max(blocks_[block_index].max_term_freq, term_freq);
+    const auto pos = lower_bound(document_ids, document_ids + block_size, document_id) - document_ids;
+    copy_backward(document_ids + pos, document_ids + block_size, document_ids + block_size + 1);
+    copy_backward(counts + pos, counts + block_size, counts + block_size + 1);
+    document_ids[pos] = document_id;
+    counts[pos] = count;
+
+    if (block_size < BLOCK_SIZE) {
+        ReplaceBlock(block_index, document_ids, counts, block_size + 1, max_term_freq);
+        return;
+    }
+
+    const size_t half = (BLOCK_SIZE + 1) / 2;
+    const Block second_half = EncodeBlock(document_ids + half, counts + half, BLOCK_SIZE + 1 - half,
+        max_term_freq);
+    blocks_.insert(blocks_.begin() + block_index + 1, second_half);
+    ReplaceBlock(block_index, document_ids, counts, half, max_term_freq);
+}
+
+void PostingList::SealTail() {
+    blocks_.push_back(EncodeBlock(tail_ids_.data(), tail_counts_.data(), tail_ids_.size(),
+        tail_max_term_freq_));
+    tail_ids_.clear();
+    tail_counts_.clear();
+    tail_max_term_freq_ = 0.0f;
+}
+
+PostingList::Cursor::Cursor(const PostingList& postings)
+    : postings_(postings.GetView()) {
+    LoadBlock(0);
+}
+
+bool PostingList::Cursor::IsEnd() const {
+    return document_id_ == END;
+}
+
+int PostingList::Cursor::GetDocumentId() const {
+    return document_id_;
+}
+
+uint32_t PostingList::Cursor::GetCount() const {
+    return InTail() ? postings_.tail_counts[position_] : counts_[position_];
+}
+
+void PostingList::Cursor::Next() {
+    if (++position_ == size_ && !InTail()) {
+        LoadBlock(block_index_ + 1);
+        return;
+    }
+    UpdateDocumentId();
+}
+
+void PostingList::Cursor::SkipTo(int document_id) {
+    const uint32_t id = static_cast<uint32_t>(document_id);
+    if (document_id_ >= document_id) {
+        return;
+    }
+
+    const Block* blocks = postings_.blocks;
+    const Block* blocks_end = blocks + postings_.block_count;
+    if (!InTail() && blocks[block_index_].last_document_id < id) {
+        const auto it = lower_bound(blocks + block_index_ + 1, blocks_end, id,
+            [](const Block& block, uint32_t id) {
+                return block.last_document_id < id;
+            }
+        );
+        LoadBlock(it - blocks);
+    }
+
+    const uint32_t* ids = InTail() ? postings_.tail_ids : document_ids_;
+    position_ = lower_bound(ids + position_, ids + size_, id) - ids;
+    if (position_ == size_ && !InTail()) {
+        LoadBlock(block_index_ + 1);
+        return;
+    }
+    UpdateDocumentId();
+}
+
+double PostingList::Cursor::GetBlockMaxTermFreq(int document_id) const {
+    if (IsEnd()) {
+        return 0.0;
+    }
+
+    const uint32_t id = static_cast<uint32_t>(max(document_id, document_id_));
+    const Block* blocks = postings_.blocks;
+    const Block* blocks_end = blocks + postings_.block_count;
+    if (InTail()) {
+        return postings_.tail_max_term_freq;
+    }
+    if (blocks[block_index_].last_document_id >= id) {
+        return blocks[block_index_].max_term_freq;
+    }
+
+    const auto it = lower_bound(blocks + block_index_ + 1, blocks_end, id,
+        [](const Block& block, uint32_t id) {
+            return block.last_document_id < id;
+        }
+    );
+    return it == blocks_end ? postings_.tail_max_term_freq : it->max_term_freq;
+}
+
+bool PostingList::Cursor::InTail() const {
+    return block_index_ == postings_.block_count;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    block_index_ = block_index;
+    position_ = 0;
+
+    if (InTail()) {
+        size_ = postings_.tail_size;
+    } else {
+        const Block& block = postings_.blocks[block_index];
+        DecodeBlock(block, postings_.data, document_ids_, counts_);
+        size_ = block.size;
+    }
+    UpdateDocumentId();
+}
+
+void PostingList::Cursor::UpdateDocumentId() {
+    if (position_ >= size_) {
+        document_id_ = END;
+        return;
+    }
+    document_id_ = static_cast<int>(InTail() ? postings_.tail_ids[position_] : document_ids_[position_]);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Список вхождений слова: id документов по возрастанию и количество вхождений
+// слова в каждый из них. Заполненные блоки по BLOCK_SIZE записей хранятся
+// сжатыми: id кодируются дельтами с шагом 4 и вместе со счётчиками
+// упаковываются по битам в вертикальной раскладке на 4 линии, которую
+// SSE2-ядро распаковывает по 4 значения за инструкцию. Неполный хвост
+// хранится как есть, поэтому добавление в конец не требует перепаковки.
+// Для каждого блока хранится верхняя оценка tf его записей, по которой
+// досрочное вычисление запроса пропускает блоки без распаковки.
+// Сжатые данные всех блоков лежат в одном массиве, поэтому список может
+// читать их и из внешней памяти, например из отображённого файла индекса.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    // Заголовок сжатого блока; данные блока — id_bits + count_bits групп по
+    // 4 слова начиная со слова data_offset
+    struct Block {
+        std::uint32_t first_document_id = 0;
+        std::uint32_t last_document_id = 0;
+        std::uint32_t data_offset = 0;
+        std::uint8_t size = 0;
+        std::uint8_t id_bits = 0;
+        std::uint8_t count_bits = 0;
+        std::uint8_t reserved = 0;
+        float max_term_freq = 0.0f;
+    };
+
+    // Всё содержимое списка в виде указателей на массивы
+    struct View {
+        const Block* blocks = nullptr;
+        size_t block_count = 0;
+        const std::uint32_t* data = nullptr;
+        size_t data_size = 0;
+        const std::uint32_t* tail_ids = nullptr;
+        const std::uint32_t* tail_counts = nullptr;
+        size_t tail_size = 0;
+        float tail_max_term_freq = 0.0f;
+        float max_term_freq = 0.0f;
+        size_t size = 0;
+    };
+
+    PostingList() = default;
+    // Список только для чтения поверх чужих массивов, которые должны жить
+    // дольше него. Insert и Erase для такого списка вызывать нельзя
+    explicit PostingList(const View& view);
+
+    // term_freq — tf слова в документе, используется только для верхних оценок
+    void Insert(int document_id, std::uint32_t count, double term_freq);
+    // Оценки после удаления не уменьшаются, но остаются верхними
+    void Erase(int document_id);
+
+    size_t Size() const;
+    bool Empty() const;
+    // Верхняя оценка tf по всем записям
+    double GetMaxTermFreq() const;
+    View GetView() const;
+
+    // Распаковывать блоки скалярным кодом, даже если процессор поддерживает
+    // SSE2, чтобы проверить запасной путь. Переключать можно, только пока
+    // никакой список не обходится
+    static void ForceScalarDecoding(bool force);
+
+    // func(int document_id, std::uint32_t count) вызывается для всех
+    // записей в порядке возрастания id
+    template <typename Func>
+    void ForEach(Func func) const;
+
+    // Последовательный обход с пропуском целых блоков по диапазону id,
+    // распаковывает только те блоки, в которые действительно заходит
+    class Cursor {
+    public:
+        static constexpr int END = 2147483647;
+
+        explicit Cursor(const PostingList& postings);
+
+        bool IsEnd() const;
+        // Для исчерпанного курсора возвращает END
+        int GetDocumentId() const;
+        std::uint32_t GetCount() const;
+
+        void Next();
+        // Переходит к первой записи с id не меньше document_id
+        void SkipTo(int document_id);
+
+        // Верхняя оценка tf в блоке, где находилась бы запись document_id
+        // (не меньше текущей), без распаковки и без сдвига курсора
+        double GetBlockMaxTermFreq(int document_id) const;
+
+    private:
+        View postings_;
+        size_t block_index_ = 0;
+        size_t position_ = 0;
+        size_t size_ = 0;
+        int document_id_ = END;
+        alignas(16) std::uint32_t document_ids_[BLOCK_SIZE];
+        alignas(16) std::uint32_t counts_[BLOCK_SIZE];
+
+        bool InTail() const;
+        void LoadBlock(size_t block_index);
+        void UpdateDocumentId();
+    };
+
+private:
+    std::vector<Block> blocks_;
+    // сжатые данные блоков; данные перекодированных блоков остаются в
+    // массиве мусором, пока его не станет больше половины
+    std::vector<std::uint32_t> data_;
+    size_t garbage_size_ = 0;
+    std::vector<std::uint32_t> tail_ids_;
+    std::vector<std::uint32_t> tail_counts_;
+    float tail_max_term_freq_ = 0.0f;
+    float max_term_freq_ = 0.0f;
+    size_t size_ = 0;
+    // внешние массивы списка только для чтения
+    bool is_view_ = false;
+    View view_;
+
+    // Сжимает блок, дописывая его данные в конец data_
+    Block EncodeBlock(const std::uint32_t* document_ids,
+        const std::uint32_t* counts, size_t size, float max_term_freq);
+    // Перекодирует блок block_index, учитывая его прежние данные как мусор
+    void ReplaceBlock(size_t block_index, const std::uint32_t* document_ids,
+        const std::uint32_t* counts, size_t size, float max_term_freq);
+    void CollectGarbage();
+    static void DecodeBlock(const Block& block, const std::uint32_t* data,
+        std::uint32_t* document_ids, std::uint32_t* counts);
+
+    void InsertIntoBlock(size_t block_index, std::uint32_t document_id, std::uint32_t count,
+        float term_freq);
+    void SealTail();
+};
+
+template <typename Func>
+void PostingList::ForEach(Func func) const {
+    alignas(16) std::uint32_t document_ids[BLOCK_SIZE];
+    alignas(16) std::uint32_t counts[BLOCK_SIZE];
+    const View view = GetView();
+
+    for (size_t block_index = 0; block_index < view.block_count; ++block_index) {
+        const Block& block = view.blocks[block_index];
+        DecodeBlock(block, view.data, document_ids, counts);
+        for (size_t i = 0; i < block.size; ++i) {
+            func(static_cast<int>(document_ids[i]), counts[i]);
+        }
+    }
+
+    for (size_t i = 0; i < view.tail_size; ++i) {
+        func(static_cast<int>(view.tail_ids[i]), view.tail_counts[i]);
+    }
+}
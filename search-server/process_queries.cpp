@@ -1,7 +1,5 @@
 #include "process_queries.h"
 
-#include <execution>
-
 using namespace std;
 
 
@@ -9,33 +7,35 @@ std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
     
-    if (queries.size() == 0) {
-        return std::vector<std::vector<Document>>{};
-    }
-    
-    std::vector<std::vector<Document>> res(queries.size());
-        
-    std::transform(execution::par, queries.begin(), queries.end(), res.begin(),
-        [&search_server](const string& q) { 
-            return search_server.FindTopDocuments(q);
-        }
-    );
-    
-    return res;
+    const vector<string_view> raw_queries(queries.begin(), queries.end());
+    return search_server.FindTopDocumentsBatch(raw_queries);
 }
 
-std::list<Document> ProcessQueriesJoined(
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
     
-    std::list<Document> res;
-    std::list<Document> from;
+    vector<size_t> offsets;
+    return ProcessQueriesJoined(search_server, queries, offsets);
+}
+
+std::vector<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    std::vector<size_t>& offsets) {
+    
+    const auto results = ProcessQueries(search_server, queries);
     
-    for (const auto& q_res : ProcessQueries(search_server, queries)) {
-        from.assign(q_res.begin(), q_res.end());
-        
-        res.splice(res.end(), from);
+    offsets.assign(1, 0);
+    for (const auto& q_res : results) {
+        offsets.push_back(offsets.back() + q_res.size());
+    }
+    
+    std::vector<Document> res;
+    res.reserve(offsets.back());
+    for (const auto& q_res : results) {
+        res.insert(res.end(), q_res.begin(), q_res.end());
     }
     
    return res;
-}
\ No newline at end of file
+}
@@ -1,11 +1,23 @@
+#pragma once
 #include "search_server.h"
 
-#include <list>
+#include <string>
+#include <vector>
 
+// Выдачи запросов по порядку; пакет выполняется
+// SearchServer::FindTopDocumentsBatch
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries); 
 
-std::list<Document> ProcessQueriesJoined(
+// Выдачи всех запросов подряд в одном векторе
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries); 
\ No newline at end of file
+    const std::vector<std::string>& queries); 
+
+// То же; выдача запроса i занимает [offsets[i], offsets[i + 1])
+std::vector<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries,
+    std::vector<size_t>& offsets); 
+
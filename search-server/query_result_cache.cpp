@@ -0,0 +1,191 @@
+#include "query_result_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+using namespace std;
+
+namespace {
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+constexpr size_t SHARD_COUNT = 16;
+constexpr size_t SKETCH_DEPTH = 4;
+constexpr uint32_t MAX_FREQUENCY = 15;
+// примерный размер записи для выбора ширины sketch
+constexpr size_t TYPICAL_ENTRY_BYTES = 256;
+constexpr size_t MIN_SKETCH_WIDTH = 1024;
+// узлы списка и хеш-таблицы сверх самой записи
+constexpr size_t ENTRY_OVERHEAD = 64;
+
+} // namespace
+
+QueryResultCache::FrequencySketch::FrequencySketch(size_t width) {
+    size_t word_count = 1;
+    while (word_count * 16 < width) {
+        word_count *= 2;
+    }
+    words_.assign(word_count, 0);
+    word_mask_ = word_count - 1;
+    // за период каждый счётчик в среднем успевает набрать около 10
+    reset_period_ = word_count * 16 * 10;
+}
+
+void QueryResultCache::FrequencySketch::Increment(uint64_t hash) {
+    for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+        const size_t counter = GetCounter(hash, row);
+        uint64_t& word = words_[counter / 16];
+        const size_t shift = (counter % 16) * 4;
+        if (((word >> shift) & 0xF) < MAX_FREQUENCY) {
+            word += uint64_t{1} << shift;
+        }
+    }
+    if (++increment_count_ == reset_period_) {
+        Halve();
+    }
+}
+
+uint32_t QueryResultCache::FrequencySketch::Estimate(uint64_t hash) const {
+    uint32_t frequency = MAX_FREQUENCY;
+    for (size_t row = 0; row < SKETCH_DEPTH; ++row) {
+        const size_t counter = GetCounter(hash, row);
+        frequency = min(frequency, static_cast<uint32_t>((words_[counter / 16] >> ((counter % 16) * 4)) & 0xF));
+    }
+    return frequency;
+}
+
+size_t QueryResultCache::FrequencySketch::GetCounter(uint64_t hash, size_t row) const {
+    return static_cast<size_t>(Mix(hash + row * 0x9E3779B97F4A7C15ull)) & (word_mask_ * 16 + 15);
+}
+
+// старые обращения весят вдвое меньше новых
+void QueryResultCache::FrequencySketch::Halve() {
+    for (uint64_t& word : words_) {
+        word = (word >> 1) & 0x7777777777777777ull;
+    }
+    increment_count_ = 0;
+}
+
+QueryResultCache::Shard::Shard(size_t sketch_width)
+    : sketch(sketch_width) {
+}
+
+void QueryResultCache::Shard::Erase(list<Entry>::iterator it) {
+    size_bytes -= it->size_bytes;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+QueryResultCache::QueryResultCache(size_t max_bytes)
+    : max_shard_bytes_(max_bytes / SHARD_COUNT) {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        // счётчиков с запасом: частоты нужны и ключам, которых нет в кеше
+        shards_.push_back(make_unique<Shard>(
+            max(4 * max_shard_bytes_ / TYPICAL_ENTRY_BYTES, MIN_SKETCH_WIDTH)));
+    }
+}
+
+bool QueryResultCache::Find(string_view key, uint64_t epoch, vector<Document>& documents) {
+    const uint64_t hash = HashKey(key);
+    Shard& shard = GetShard(hash);
+    const lock_guard guard(shard.m);
+
+    shard.sketch.Increment(hash);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end() || it->second->epoch != epoch) {
+        if (it != shard.index.end() && it->second->epoch < epoch) {
+            shard.Erase(it->second);
+        }
+        ++shard.stats.misses;
+        return false;
+    }
+
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    documents = it->second->documents;
+    ++shard.stats.hits;
+    return true;
+}
+
+void QueryResultCache::Insert(string key, uint64_t epoch, const vector<Document>& documents) {
+    const uint64_t hash = HashKey(key);
+    Shard& shard = GetShard(hash);
+    const size_t size_bytes = sizeof(Entry) + ENTRY_OVERHEAD + key.size()
+        + documents.size() * sizeof(Document);
+    const lock_guard guard(shard.m);
+
+    // выдача, посчитанная по уже изменённому индексу, не понадобится
+    if (epoch < shard.epoch) {
+        return;
+    }
+    // первая вставка новой эпохи удаляет все записи прошлых: в шарде
+    // остаются записи только одной эпохи
+    if (epoch > shard.epoch) {
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            const auto next_it = next(it);
+            if (it->epoch < epoch) {
+                shard.Erase(it);
+            }
+            it = next_it;
+        }
+        shard.epoch = epoch;
+    }
+    // ту же выдачу мог успеть добавить другой поток
+    if (shard.index.count(key) > 0) {
+        return;
+    }
+    if (size_bytes > max_shard_bytes_) {
+        ++shard.stats.rejections;
+        return;
+    }
+
+    // Вытесняемые записи выбираются с конца LRU до тех пор, пока не хватит
+    // места, и удаляются, только если все они запрашивались реже новой
+    const uint32_t frequency = shard.sketch.Estimate(hash);
+    size_t freed_bytes = 0;
+    auto victims_begin = shard.entries.end();
+    while (shard.size_bytes - freed_bytes + size_bytes > max_shard_bytes_) {
+        --victims_begin;
+        if (shard.sketch.Estimate(HashKey(victims_begin->key)) >= frequency) {
+            ++shard.stats.rejections;
+            return;
+        }
+        freed_bytes += victims_begin->size_bytes;
+    }
+    while (victims_begin != shard.entries.end()) {
+        shard.Erase(victims_begin++);
+    }
+
+    shard.entries.push_front({move(key), epoch, documents, size_bytes});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.size_bytes += size_bytes;
+}
+
+QueryResultCache::Stats QueryResultCache::GetStats() const {
+    Stats result;
+    for (const auto& shard : shards_) {
+        const lock_guard guard(shard->m);
+        result.hits += shard->stats.hits;
+        result.misses += shard->stats.misses;
+        result.rejections += shard->stats.rejections;
+        result.entry_count += shard->entries.size();
+        result.size_bytes += shard->size_bytes;
+    }
+    return result;
+}
+
+uint64_t QueryResultCache::HashKey(string_view key) {
+    return hash<string_view>{}(key);
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(uint64_t hash) {
+    // младшие биты перемешанного хеша выбирают счётчики sketch
+    return *shards_[(Mix(hash) >> 32) % SHARD_COUNT];
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "document.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Кеш выдач запросов, ограниченный суммарным размером записей в байтах.
+// Запись помнит эпоху индекса, при которой посчитана выдача; запись другой
+// эпохи считается промахом, так что изменение индекса сбрасывает весь кеш
+// одним увеличением счётчика. Первая вставка новой эпохи удаляет из шарда
+// все записи прошлых эпох, а выдачи прошлых эпох в кеш не попадают.
+// Ключи раскладываются по шардам, у каждого свой мьютекс, свой список LRU и
+// своя частотная оценка TinyLFU: count-min sketch из 4-битных счётчиков,
+// которые периодически делятся пополам. При нехватке места новая запись
+// вытесняет самые давние, только если её ключ запрашивали чаще, чем их, поэтому
+// разовые запросы не вымывают повторяющиеся.
+class QueryResultCache {
+public:
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        // выдачи, которые не попали в кеш из-за политики допуска
+        std::uint64_t rejections = 0;
+        size_t entry_count = 0;
+        size_t size_bytes = 0;
+    };
+
+    explicit QueryResultCache(size_t max_bytes);
+
+    // Находит выдачу, посчитанную при эпохе epoch. Каждое обращение
+    // учитывается в частоте ключа
+    bool Find(std::string_view key, std::uint64_t epoch, std::vector<Document>& documents);
+    void Insert(std::string key, std::uint64_t epoch, const std::vector<Document>& documents);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        std::uint64_t epoch;
+        std::vector<Document> documents;
+        size_t size_bytes;
+    };
+
+    // 16 счётчиков по 4 бита в слове, SKETCH_DEPTH строк
+    class FrequencySketch {
+    public:
+        explicit FrequencySketch(size_t width);
+
+        void Increment(std::uint64_t hash);
+        std::uint32_t Estimate(std::uint64_t hash) const;
+
+    private:
+        std::vector<std::uint64_t> words_;
+        size_t word_mask_;
+        size_t increment_count_ = 0;
+        size_t reset_period_;
+
+        size_t GetCounter(std::uint64_t hash, size_t row) const;
+        void Halve();
+    };
+
+    struct Shard {
+        std::mutex m;
+        // начало списка — последние использованные записи
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        FrequencySketch sketch;
+        size_t size_bytes = 0;
+        // наибольшая эпоха вставленных записей
+        std::uint64_t epoch = 0;
+        Stats stats;
+
+        explicit Shard(size_t sketch_width);
+        void Erase(std::list<Entry>::iterator it);
+    };
+
+    size_t max_shard_bytes_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    static std::uint64_t HashKey(std::string_view key);
+    Shard& GetShard(std::uint64_t hash);
+};
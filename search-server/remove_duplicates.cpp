@@ -1,32 +1,240 @@
 #include "remove_duplicates.h"
 
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
 using namespace std;
 
+namespace {
+
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// число хеш-функций MinHash-сигнатуры
+constexpr size_t SIGNATURE_SIZE = 64;
+// сигнатуры считаются параллельно для стольких документов сразу
+constexpr size_t SIGNATURE_BLOCK_SIZE = 1 << 16;
+// вероятность, с которой LSH находит пару с коэффициентом ровно на пороге
+constexpr double MIN_CANDIDATE_PROBABILITY = 0.95;
+
+void ReportDuplicates(const vector<int>& document_ids) {
+    string report;
+    for (const int document_id : document_ids) {
+        report += "Found duplicate document id "s + to_string(document_id) + '\n';
+    }
+    cout << report << flush;
+}
+
+} // namespace
 
 void RemoveDuplicates(SearchServer& search_server) {
+    using DocumentTerm = SearchServer::DocumentTerm;
 
-  vector<int> ids_to_remove;
+    // документы по возрастанию id
+    vector<pair<int, int>> documents(search_server.document_ordinals_.begin(),
+        search_server.document_ordinals_.end());
+    const auto get_terms = [&](size_t i) {
+        return search_server.document_terms_[documents[i].second];
+    };
+
+    // сумма хешей слов не зависит от их порядка
+    vector<pair<uint64_t, size_t>> fingerprints(documents.size());
+    vector<size_t> positions(documents.size());
+    iota(positions.begin(), positions.end(), 0);
+    transform(execution::par, positions.begin(), positions.end(), fingerprints.begin(),
+        [&](size_t i) {
+            uint64_t fingerprint = 0;
+            for (const DocumentTerm& term : get_terms(i)) {
+                fingerprint += Mix(term.term_id + 0x9E3779B97F4A7C15ull);
+            }
+            return pair{fingerprint, i};
+        });
+    sort(execution::par, fingerprints.begin(), fingerprints.end());
+
+    const auto have_same_words = [&](size_t lhs, size_t rhs) {
+        const auto lhs_terms = get_terms(lhs);
+        const auto rhs_terms = get_terms(rhs);
+        return equal(lhs_terms.begin(), lhs_terms.end(), rhs_terms.begin(), rhs_terms.end(),
+            [](const DocumentTerm& lhs_term, const DocumentTerm& rhs_term) {
+                return lhs_term.term_id == rhs_term.term_id;
+            });
+    };
+
+    // внутри группы с одним отпечатком документы идут по возрастанию id,
+    // поэтому первый документ каждого множества слов остаётся
+    vector<size_t> duplicates;
+    vector<size_t> kept;
+    for (size_t group_begin = 0; group_begin < fingerprints.size();) {
+        size_t group_end = group_begin + 1;
+        while (group_end < fingerprints.size()
+            && fingerprints[group_end].first == fingerprints[group_begin].first) {
+            ++group_end;
+        }
+
+        kept.clear();
+        for (size_t j = group_begin; j < group_end; ++j) {
+            const size_t i = fingerprints[j].second;
+            if (any_of(kept.begin(), kept.end(), [&](size_t k) { return have_same_words(k, i); })) {
+                duplicates.push_back(i);
+            } else {
+                kept.push_back(i);
+            }
+        }
+        group_begin = group_end;
+    }
+    sort(duplicates.begin(), duplicates.end());
+
+    vector<int> duplicate_ids;
+    for (const size_t i : duplicates) {
+        duplicate_ids.push_back(documents[i].first);
+    }
+    ReportDuplicates(duplicate_ids);
+    search_server.RemoveDocuments(execution::par, duplicate_ids);
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold) {
+    using DocumentTerm = SearchServer::DocumentTerm;
+
+    if (!(similarity_threshold > 0 && similarity_threshold <= 1)) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+
+    // Подпись делится на band_count полос по row_count корзин; документы
+    // становятся кандидатами, если у них совпала хотя бы одна полоса. Чем
+    // длиннее полоса, тем меньше лишних кандидатов, поэтому берётся самая
+    // длинная, при которой пара на пороге находится с заданной вероятностью
+    size_t row_count = 1;
+    for (size_t rows = SIGNATURE_SIZE; rows >= 1; --rows) {
+        const double bands = static_cast<double>(SIGNATURE_SIZE / rows);
+        if (1 - pow(1 - pow(similarity_threshold, rows), bands) >= MIN_CANDIDATE_PROBABILITY) {
+            row_count = rows;
+            break;
+        }
+    }
+    const size_t band_count = SIGNATURE_SIZE / row_count;
+
+    vector<pair<int, int>> documents(search_server.document_ordinals_.begin(),
+        search_server.document_ordinals_.end());
+    const auto get_terms = [&](size_t i) {
+        return search_server.document_terms_[documents[i].second];
+    };
+
+    // хеш-функции сигнатуры — умножение хеша слова на нечётные множители
+    // со взятием старших битов
+    uint64_t multipliers[SIGNATURE_SIZE];
+    for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+        multipliers[k] = Mix(k + 1) | 1;
+    }
 
-  set<set<string_view>> duplicate_container;
+    // Ключи полос документа. Сигнатура по одной перестановке с заполнением
+    // пустых корзин соседними здесь не годится: у коротких документов
+    // соседние корзины совпадают вместе, и случайные пары часто становятся
+    // кандидатами
+    const auto compute_band_keys = [&](size_t i, uint64_t* band_keys) {
+        uint32_t signature[SIGNATURE_SIZE];
+        fill(begin(signature), end(signature), UINT32_MAX);
+        for (const DocumentTerm& term : get_terms(i)) {
+            const uint64_t hash = Mix(term.term_id + 0x9E3779B97F4A7C15ull);
+            for (size_t k = 0; k < SIGNATURE_SIZE; ++k) {
+                signature[k] = min(signature[k], static_cast<uint32_t>((hash * multipliers[k]) >> 32));
+            }
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = Mix(band + 1);
+            for (size_t row = 0; row < row_count; ++row) {
+                key = Mix(key ^ signature[band * row_count + row]);
+            }
+            band_keys[band] = key;
+        }
+    };
 
-  for (const int document_id  : search_server) {
-      const auto& words_freqs = search_server.GetWordFrequencies(document_id);
+    const auto compute_similarity = [&](size_t lhs, size_t rhs) {
+        const auto lhs_terms = get_terms(lhs);
+        const auto rhs_terms = get_terms(rhs);
+        const size_t lhs_size = static_cast<size_t>(lhs_terms.end() - lhs_terms.begin());
+        const size_t rhs_size = static_cast<size_t>(rhs_terms.end() - rhs_terms.begin());
+        if (lhs_size + rhs_size == 0) {
+            return 1.0;
+        }
+        size_t common = 0;
+        for (auto l = lhs_terms.begin(), r = rhs_terms.begin(); l != lhs_terms.end() && r != rhs_terms.end();) {
+            if (l->term_id < r->term_id) {
+                ++l;
+            } else if (r->term_id < l->term_id) {
+                ++r;
+            } else {
+                ++common;
+                ++l;
+                ++r;
+            }
+        }
+        return static_cast<double>(common) / static_cast<double>(lhs_size + rhs_size - common);
+    };
 
-      set<string_view> unique_words;
+    // Документ сравнивается только с оставленными документами с меньшим id.
+    // Документы с одним ключом полосы связаны в список: таблица хранит номер
+    // последней записи списка плюс один, записи — документ и предыдущую
+    unordered_map<uint64_t, uint32_t> bucket_heads;
+    vector<pair<size_t, uint32_t>> bucket_entries;
+    vector<size_t> last_checked(documents.size(), SIZE_MAX);
+    vector<uint64_t> band_keys;
+    vector<size_t> positions;
+    vector<int> duplicate_ids;
+    for (size_t block_begin = 0; block_begin < documents.size(); block_begin += SIGNATURE_BLOCK_SIZE) {
+        const size_t block_end = min(documents.size(), block_begin + SIGNATURE_BLOCK_SIZE);
+        band_keys.resize((block_end - block_begin) * band_count);
+        positions.resize(block_end - block_begin);
+        iota(positions.begin(), positions.end(), block_begin);
+        for_each(execution::par, positions.begin(), positions.end(),
+            [&](size_t i) {
+                compute_band_keys(i, &band_keys[(i - block_begin) * band_count]);
+            });
 
-      for (const auto& [word, _] : words_freqs) {
-        unique_words.insert(word);
-      }
+        for (size_t i = block_begin; i < block_end; ++i) {
+            const uint64_t* keys = &band_keys[(i - block_begin) * band_count];
+            bool is_duplicate = false;
+            for (size_t band = 0; band < band_count && !is_duplicate; ++band) {
+                const auto head_it = bucket_heads.find(keys[band]);
+                if (head_it == bucket_heads.end()) {
+                    continue;
+                }
+                for (uint32_t entry = head_it->second; entry != 0; entry = bucket_entries[entry - 1].second) {
+                    const size_t candidate = bucket_entries[entry - 1].first;
+                    if (last_checked[candidate] == i) {
+                        continue;
+                    }
+                    last_checked[candidate] = i;
+                    if (compute_similarity(candidate, i) >= similarity_threshold) {
+                        is_duplicate = true;
+                        break;
+                    }
+                }
+            }
 
-      if (duplicate_container.count(unique_words) > 0) {
-        ids_to_remove.push_back(document_id);
-        cout << "Found duplicate document id " << document_id << endl;
-      } else {
-        duplicate_container.insert(unique_words);
-      }
+            if (is_duplicate) {
+                duplicate_ids.push_back(documents[i].first);
+            } else {
+                for (size_t band = 0; band < band_count; ++band) {
+                    uint32_t& head = bucket_heads[keys[band]];
+                    bucket_entries.emplace_back(i, head);
+                    head = static_cast<uint32_t>(bucket_entries.size());
+                }
+            }
+        }
     }
 
-  for (const int id_to_remove : ids_to_remove) {
-    search_server.RemoveDocument(id_to_remove);
-  }
-}
\ No newline at end of file
+    ReportDuplicates(duplicate_ids);
+    search_server.RemoveDocuments(execution::par, duplicate_ids);
+}
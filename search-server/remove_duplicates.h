@@ -1,4 +1,15 @@
 #pragma once
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Удаляет документы, множество слов которых совпадает с множеством слов
+// документа с меньшим id, и сообщает о каждом в cout. Отпечатки множеств
+// считаются параллельно и сравниваются через хеш-таблицу; совпадение
+// отпечатков перепроверяется по самим множествам
+void RemoveDuplicates(SearchServer& search_server);
+
+// То же для почти совпадающих документов: удаляется документ, у которого
+// с одним из оставленных документов с меньшим id коэффициент Жаккара
+// множеств слов не меньше similarity_threshold (из (0, 1]). Кандидаты
+// подбираются по MinHash-сигнатурам (LSH), поэтому пары с коэффициентом
+// чуть выше порога изредка пропускаются; найденные пары проверяются точно
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold);
@@ -1,20 +1,182 @@
 #include "request_queue.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : search_server_(search_server) {
+RequestQueue::RequestQueue(const SearchServer& search_server, size_t capacity)
+    : search_server_(search_server)
+    , capacity_(capacity) {
+
+    if (capacity == 0) {
+        throw invalid_argument("Request queue capacity must be positive"s);
+    }
+    slots_ = make_unique<Slot[]>(capacity);
+    for (auto& bucket : latency_buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status;
-    });
+vector<Document> RequestQueue::AddFindRequest(string_view raw_query, DocumentStatus status) {
+    const auto start = chrono::steady_clock::now();
+    vector<Document> documents = search_server_.FindTopDocuments(raw_query, status);
+    const auto finish = chrono::steady_clock::now();
+    Record(finish, finish - start, documents.size());
+    return documents;
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
+vector<Document> RequestQueue::AddFindRequest(string_view raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
 
+void RequestQueue::AddRequest(chrono::steady_clock::duration latency, size_t document_count) {
+    Record(chrono::steady_clock::now(), latency, document_count);
+}
+
+size_t RequestQueue::GetRequestCount() const {
+    return static_cast<size_t>(occupied_count_.load(memory_order_acquire));
+}
+
 int RequestQueue::GetNoResultRequests() const {
-    return empty_requests_number;
-}
\ No newline at end of file
+    return no_result_count_.load(memory_order_relaxed);
+}
+
+double RequestQueue::GetNoResultRate() const {
+    const size_t request_count = GetRequestCount();
+    return request_count == 0 ? 0.0
+        : static_cast<double>(GetNoResultRequests()) / static_cast<double>(request_count);
+}
+
+double RequestQueue::GetAverageDocumentCount() const {
+    const size_t request_count = GetRequestCount();
+    return request_count == 0 ? 0.0
+        : static_cast<double>(document_count_.load(memory_order_relaxed)) / static_cast<double>(request_count);
+}
+
+double RequestQueue::GetRequestsPerSecond() const {
+    const size_t request_count = GetRequestCount();
+    if (request_count == 0) {
+        return 0.0;
+    }
+    // самый ранний запрос окна — в ячейке, которую запишет следующий запрос;
+    // если её уже перезаписывают, берётся время более позднего запроса
+    const Slot& oldest = slots_[request_count < capacity_ ? 0
+        : next_request_.load(memory_order_relaxed) % capacity_];
+    const int64_t oldest_time = oldest.finish_time.load(memory_order_relaxed);
+    const int64_t now = chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+    const double seconds = static_cast<double>(max<int64_t>(now - oldest_time, 1)) / 1e9;
+    return static_cast<double>(request_count) / seconds;
+}
+
+chrono::microseconds RequestQueue::GetLatencyPercentile(double percentile) const {
+    if (!(percentile >= 0 && percentile <= 1)) {
+        throw invalid_argument("Percentile must be in [0, 1]"s);
+    }
+    const size_t request_count = GetRequestCount();
+    if (request_count == 0) {
+        return chrono::microseconds(0);
+    }
+    const uint64_t rank = max<uint64_t>(
+        static_cast<uint64_t>(ceil(percentile * static_cast<double>(request_count))), 1);
+    uint64_t counted = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+        counted += latency_buckets_[bucket].load(memory_order_relaxed);
+        if (counted >= rank) {
+            return chrono::microseconds(GetLatencyBucketBound(bucket));
+        }
+    }
+    // счётчик окна опередил гистограмму, пока записывается запрос
+    for (size_t bucket = LATENCY_BUCKET_COUNT; bucket > 0; --bucket) {
+        if (latency_buckets_[bucket - 1].load(memory_order_relaxed) != 0) {
+            return chrono::microseconds(GetLatencyBucketBound(bucket - 1));
+        }
+    }
+    return chrono::microseconds(0);
+}
+
+uint64_t RequestQueue::GetDroppedRequests() const {
+    return dropped_count_.load(memory_order_relaxed);
+}
+
+void RequestQueue::Record(chrono::steady_clock::time_point finish_time,
+    chrono::steady_clock::duration latency, size_t document_count) {
+
+    const int64_t latency_us = chrono::duration_cast<chrono::microseconds>(latency).count();
+    const uint64_t result = (static_cast<uint64_t>(clamp<int64_t>(latency_us, 0, UINT32_MAX)) << 32)
+        | min<uint64_t>(document_count, UINT32_MAX);
+
+    const uint64_t request = next_request_.fetch_add(1, memory_order_relaxed);
+    Slot& slot = slots_[request % capacity_];
+    // ячейку пишет запрос кругом раньше или она уже отдана более позднему
+    // запросу: ждать нельзя, запись пропускается
+    uint64_t state = slot.state.load(memory_order_relaxed);
+    do {
+        if ((state & SLOT_BUSY) != 0 || state > request) {
+            dropped_count_.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+    } while (!slot.state.compare_exchange_weak(state, (request + 1) | SLOT_BUSY,
+        memory_order_acquire, memory_order_relaxed));
+
+    const bool is_replacing = state != 0;
+    const uint64_t evicted = slot.result.load(memory_order_relaxed);
+    slot.finish_time.store(chrono::duration_cast<chrono::nanoseconds>(
+        finish_time.time_since_epoch()).count(), memory_order_relaxed);
+    slot.result.store(result, memory_order_relaxed);
+    Account(result, is_replacing, evicted);
+    slot.state.store(request + 1, memory_order_release);
+    if (!is_replacing) {
+        occupied_count_.fetch_add(1, memory_order_release);
+    }
+}
+
+// Заменяет в суммах окна вытесненную запись новой. Общие счётчики меняются,
+// только если вклады записей различаются
+void RequestQueue::Account(uint64_t result, bool is_replacing, uint64_t evicted) {
+    const uint32_t document_count = static_cast<uint32_t>(result);
+    const size_t bucket = GetLatencyBucket(static_cast<uint32_t>(result >> 32));
+    int no_result_delta = document_count == 0 ? 1 : 0;
+    uint64_t document_delta = document_count;
+    if (is_replacing) {
+        const uint32_t evicted_document_count = static_cast<uint32_t>(evicted);
+        const size_t evicted_bucket = GetLatencyBucket(static_cast<uint32_t>(evicted >> 32));
+        no_result_delta -= evicted_document_count == 0 ? 1 : 0;
+        document_delta -= evicted_document_count;
+        if (evicted_bucket != bucket) {
+            latency_buckets_[evicted_bucket].fetch_sub(1, memory_order_relaxed);
+            latency_buckets_[bucket].fetch_add(1, memory_order_relaxed);
+        }
+    } else {
+        latency_buckets_[bucket].fetch_add(1, memory_order_relaxed);
+    }
+    if (no_result_delta != 0) {
+        no_result_count_.fetch_add(no_result_delta, memory_order_relaxed);
+    }
+    if (document_delta != 0) {
+        document_count_.fetch_add(document_delta, memory_order_relaxed);
+    }
+}
+
+// Задержки меньше 8 мкс хранятся точно, остальные — по 8 интервалов
+// на каждую степень двойки
+size_t RequestQueue::GetLatencyBucket(uint32_t latency) {
+    if (latency < LATENCY_SUBBUCKET_COUNT) {
+        return latency;
+    }
+    const size_t exponent = 31 - static_cast<size_t>(__builtin_clz(latency));
+    const size_t subbucket = (latency >> (exponent - 3)) & (LATENCY_SUBBUCKET_COUNT - 1);
+    return (exponent - 2) * LATENCY_SUBBUCKET_COUNT + subbucket;
+}
+
+uint32_t RequestQueue::GetLatencyBucketBound(size_t bucket) {
+    if (bucket < LATENCY_SUBBUCKET_COUNT) {
+        return static_cast<uint32_t>(bucket);
+    }
+    const size_t exponent = bucket / LATENCY_SUBBUCKET_COUNT + 2;
+    const uint64_t subbucket = bucket % LATENCY_SUBBUCKET_COUNT;
+    return static_cast<uint32_t>(((LATENCY_SUBBUCKET_COUNT + subbucket + 1) << (exponent - 3)) - 1);
+}
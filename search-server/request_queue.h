@@ -1,52 +1,96 @@
 #pragma once
 #include "search_server.h"
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
 
+// Статистика последних запросов. Запросы записываются в кольцевой буфер
+// фиксированной ёмкости компактными записями: время завершения, задержка и
+// число найденных документов (ноль — пустая выдача). Вместе с записью
+// обновляются суммы по окну и гистограмма задержек, поэтому доля пустых
+// выдач, частота запросов и процентили задержки считаются без обхода буфера.
+// Добавлять запросы можно из многих потоков без блокировок и ожиданий: поток
+// получает номер ячейки атомарным счётчиком и захватывает ячейку одним CAS.
+// Если ячейку ещё пишет запрос кругом раньше или её уже занял более поздний
+// запрос, запись пропускается и учитывается в GetDroppedRequests. Значения,
+// прочитанные во время записи, могут не учитывать запросы, которые
+// записываются в этот момент
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
-    
+    // запросы за сутки при одном запросе в минуту
+    static constexpr size_t DEFAULT_CAPACITY = 1440;
+
+    explicit RequestQueue(const SearchServer& search_server, size_t capacity = DEFAULT_CAPACITY);
+
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(std::string_view raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(std::string_view raw_query);
+    // Учитывает запрос, выполненный в обход очереди и завершившийся сейчас
+    void AddRequest(std::chrono::steady_clock::duration latency, size_t document_count);
+
+    // Значения ниже — по последним не более чем capacity запросам
+    size_t GetRequestCount() const;
     int GetNoResultRequests() const;
+    double GetNoResultRate() const;
+    double GetAverageDocumentCount() const;
+    // Число запросов окна, делённое на время от завершения самого раннего из них
+    double GetRequestsPerSecond() const;
+    // Задержка, которую не превысила доля percentile запросов, percentile
+    // из [0, 1]. Значение округляется вверх с точностью до 1/8
+    std::chrono::microseconds GetLatencyPercentile(double percentile) const;
+    // Запросы, запись которых пропущена из-за занятой ячейки, за всё время
+    std::uint64_t GetDroppedRequests() const;
+
 private:
-    struct QueryResult {
-        std::vector<Document> res;
-        bool empty;
+    // Поля записи упакованы в атомарные слова, чтобы чтение окна не
+    // пересекалось с записью
+    struct Slot {
+        // номер последнего захватившего ячейку запроса плюс один (ноль —
+        // ячейка пуста) и SLOT_BUSY, пока запрос пишет ячейку
+        std::atomic<std::uint64_t> state{0};
+        // наносекунды steady_clock
+        std::atomic<std::int64_t> finish_time{0};
+        // задержка в микросекундах в старших 32 битах, число документов — в младших
+        std::atomic<std::uint64_t> result{0};
     };
-    
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
-    int empty_requests_number = 0;
+
+    // 8 интервалов на каждую степень двойки микросекунд
+    static constexpr size_t LATENCY_SUBBUCKET_COUNT = 8;
+    static constexpr size_t LATENCY_BUCKET_COUNT = 240;
+    static constexpr std::uint64_t SLOT_BUSY = std::uint64_t{1} << 63;
+
     const SearchServer& search_server_;
-}; 
+    size_t capacity_;
+    std::unique_ptr<Slot[]> slots_;
+    // номер следующего запроса отделён от сумм окна, которые пишутся после
+    // захвата ячейки
+    alignas(64) std::atomic<std::uint64_t> next_request_{0};
+    // заполненные ячейки
+    alignas(64) std::atomic<std::uint64_t> occupied_count_{0};
+    std::atomic<std::uint64_t> dropped_count_{0};
+    std::atomic<int> no_result_count_{0};
+    std::atomic<std::uint64_t> document_count_{0};
+    std::array<std::atomic<std::uint32_t>, LATENCY_BUCKET_COUNT> latency_buckets_;
+
+    void Record(std::chrono::steady_clock::time_point finish_time,
+        std::chrono::steady_clock::duration latency, size_t document_count);
+    void Account(std::uint64_t result, bool is_replacing, std::uint64_t evicted);
+
+    static size_t GetLatencyBucket(std::uint32_t latency);
+    static std::uint32_t GetLatencyBucketBound(size_t bucket);
+};
 
 template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    QueryResult q_r;
-    q_r.res = search_server_.FindTopDocuments(raw_query, document_predicate);
-
-    if (requests_.size() == min_in_day_) {
-        auto el = requests_.front();
-
-        if (el.empty) {
-            --empty_requests_number;
-        }
-
-        requests_.pop_front();
-    }
-
-    if (!q_r.res.size()) {
-        q_r.empty = true;
-        ++empty_requests_number;
-        requests_.push_back(q_r);
-        return q_r.res;
-    }
-
-    q_r.empty = false;
-    requests_.push_back(q_r);
-    return q_r.res;
+std::vector<Document> RequestQueue::AddFindRequest(std::string_view raw_query, DocumentPredicate document_predicate) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<Document> documents = search_server_.FindTopDocuments(raw_query, document_predicate);
+    const auto finish = std::chrono::steady_clock::now();
+    Record(finish, finish - start, documents.size());
+    return documents;
 }
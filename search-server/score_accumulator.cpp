@@ -0,0 +1,30 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ScoreAccumulator::Reset(size_t document_count) {
+    if (scores_.size() < document_count) {
+        scores_.resize(document_count);
+        epochs_.resize(document_count, 0);
+        excluded_.resize((document_count + 63) / 64, 0);
+    }
+
+    // при переполнении счётчика эпох старые метки могли бы совпасть с новыми
+    if (++epoch_ == 0) {
+        fill(epochs_.begin(), epochs_.end(), 0);
+        epoch_ = 1;
+    }
+
+    touched_.clear();
+
+    for (const int word_index : excluded_words_) {
+        excluded_[word_index] = 0;
+    }
+    excluded_words_.clear();
+}
+
+const vector<int>& ScoreAccumulator::GetTouched() const {
+    return touched_;
+}
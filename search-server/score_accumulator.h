@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Плотный массив накопленной релевантности, индексируемый порядковым номером
+// документа. Ячейки помечаются номером эпохи запроса, поэтому между запросами
+// массив не очищается: Reset только увеличивает эпоху. Документы с минус-словами
+// отмечаются в битовом множестве до подсчёта и в накопитель не попадают.
+class ScoreAccumulator {
+public:
+    // Готовит накопитель к новому запросу по коллекции из document_count документов
+    void Reset(std::size_t document_count);
+
+    void Add(int ordinal, double score);
+    double GetScore(int ordinal) const;
+
+    void Exclude(int ordinal);
+    bool IsExcluded(int ordinal) const;
+
+    // Документы, получившие хотя бы один вклад, в порядке первого вклада
+    const std::vector<int>& GetTouched() const;
+
+private:
+    std::vector<double> scores_;
+    std::vector<std::uint32_t> epochs_;
+    std::vector<std::uint64_t> excluded_;
+    std::vector<int> touched_;
+    std::vector<int> excluded_words_;
+    std::uint32_t epoch_ = 0;
+};
+
+inline void ScoreAccumulator::Add(int ordinal, double score) {
+    if (epochs_[ordinal] != epoch_) {
+        epochs_[ordinal] = epoch_;
+        scores_[ordinal] = score;
+        touched_.push_back(ordinal);
+    } else {
+        scores_[ordinal] += score;
+    }
+}
+
+inline double ScoreAccumulator::GetScore(int ordinal) const {
+    return epochs_[ordinal] == epoch_ ? scores_[ordinal] : 0.0;
+}
+
+inline void ScoreAccumulator::Exclude(int ordinal) {
+    std::uint64_t& word = excluded_[ordinal / 64];
+    if (word == 0) {
+        excluded_words_.push_back(ordinal / 64);
+    }
+    word |= std::uint64_t{1} << (ordinal % 64);
+}
+
+inline bool ScoreAccumulator::IsExcluded(int ordinal) const {
+    return (excluded_[ordinal / 64] >> (ordinal % 64)) & 1;
+}
@@ -2,6 +2,75 @@
 
 using namespace std;
 
+namespace {
+
+// слово документа пакета: число вхождений и позиция первого вхождения
+struct BatchWord {
+    string_view word;
+    uint32_t count;
+    uint32_t first_position;
+};
+
+// запись обратного индекса части пакета
+struct BatchPosting {
+    string_view word;
+    int ordinal;
+    uint32_t count;
+    uint32_t first_position;
+};
+
+// слово пакета; первое вхождение определяет номер нового слова в словаре
+struct BatchTerm {
+    string_view word;
+    int first_ordinal = 0;
+    uint32_t first_position = 0;
+    uint32_t document_count = 0;
+    bool is_known = false;
+    uint32_t term_id = 0;
+    PostingList* postings = nullptr;
+};
+
+// Параллельно по блокам слов вызывает func(term, posting) для всех записей
+// слов terms из отсортированных по словам частей: записи каждого слова идут
+// по частям, то есть по возрастанию номеров документов
+template <typename Func>
+void ForEachBatchPosting(vector<BatchTerm>& terms, 
+    const vector<vector<BatchPosting>>& part_postings, size_t block_count, Func func) {
+    
+    vector<size_t> blocks(block_count);
+    iota(blocks.begin(), blocks.end(), 0);
+    for_each(execution::par, blocks.begin(), blocks.end(),
+        [&](size_t block) {
+            const size_t first = terms.size() * block / block_count;
+            const size_t last = terms.size() * (block + 1) / block_count;
+            if (first == last) {
+                return;
+            }
+            
+            vector<size_t> positions;
+            for (const auto& postings : part_postings) {
+                positions.push_back(lower_bound(postings.begin(), postings.end(), terms[first].word,
+                    [](const BatchPosting& posting, string_view word) {
+                        return posting.word < word;
+                    }) - postings.begin());
+            }
+            
+            for (size_t i = first; i < last; ++i) {
+                BatchTerm& term = terms[i];
+                for (size_t part = 0; part < part_postings.size(); ++part) {
+                    const auto& postings = part_postings[part];
+                    size_t& position = positions[part];
+                    for (; position < postings.size() && postings[position].word == term.word; ++position) {
+                        func(term, postings[position]);
+                    }
+                }
+            }
+        }
+    );
+}
+
+}
+
 SearchServer::SearchServer(string_view stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text)) {
 }
@@ -15,47 +84,631 @@ void SearchServer::AddDocument(int document_id,
     DocumentStatus status, 
     const vector<int>& ratings) {
     
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    if ((document_id < 0) || (document_ordinals_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
     
-    const auto words = SplitIntoWordsNoStop(document);
+    PollMerge();
+    
+    vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
 
     const double inv_word_count = 1.0 / words.size();
+    const int ordinal = static_cast<int>(documents_.size());
     
-    std::set<std::string_view> unique_words;
+    std::map<TermId, std::uint32_t> word_counts;
         
     for (const string_view& word : words) {
-        word_to_document_freqs_[string(word)][document_id] += inv_word_count;
-        auto it = word_to_document_freqs_.find(word);
-        unique_words.insert(it->first);
+        ++word_counts[GetOrAddTermId(word)];
     }
 
-    std::map<std::string_view, double> words_freq;
+    vector<DocumentTerm> document_terms;
+    document_terms.reserve(word_counts.size());
 
-    for (const auto& word : unique_words) {
-        words_freq[word] = word_to_document_freqs_.at(string(word)).at(document_id);
+    for (const auto [term_id, count] : word_counts) {
+        active_segment_.AddPosting(term_id, ordinal, count, count * inv_word_count);
+        ++document_freqs_[term_id];
+        document_terms.push_back({term_id, count});
     }
+    active_segment_.ExtendTo(ordinal + 1);
 
-    doc_to_words_freq_.emplace(document_id, words_freq);
-    
-    documents_.emplace(document_id, 
-        DocumentData{ComputeAverageRating(ratings), status});
+    document_terms_.push_back({document_terms.data(), document_terms.data() + document_terms.size()});
+    document_term_storage_.push_back(move(document_terms));
+    word_frequencies_.emplace_back();
+    documents_.push_back(
+        DocumentData{document_id, ComputeAverageRating(ratings), status, inv_word_count});
+    document_ordinals_.emplace(document_id, ordinal);
     document_ids_.insert(document_id);
+    
+    if (active_segment_.GetPostingCount() >= SEGMENT_POSTING_LIMIT) {
+        SealActiveSegment();
+    }
+    ++index_version_;
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    vector<int> document_ids;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0 || document_ordinals_.count(document.id) > 0) {
+            throw invalid_argument("Invalid document_id"s);
+        }
+        document_ids.push_back(document.id);
+    }
+    sort(document_ids.begin(), document_ids.end());
+    if (adjacent_find(document_ids.begin(), document_ids.end()) != document_ids.end()) {
+        throw invalid_argument("Invalid document_id"s);
+    }
+    if (documents.empty()) {
+        return;
+    }
+    
+    PollMerge();
+    
+    const size_t document_count = documents.size();
+    const int first_ordinal = static_cast<int>(documents_.size());
+    
+    // Пакет делится на части — непрерывные диапазоны документов. Каждая
+    // часть разбирает свои тексты и строит свой обратный индекс сортировкой
+    // записей (слово, документ); до проверки всех текстов сервер не меняется
+    constexpr size_t PARTS_PER_THREAD = 4;
+    const size_t part_count = min(document_count, 
+        max(1u, thread::hardware_concurrency()) * PARTS_PER_THREAD);
+    vector<size_t> parts(part_count);
+    iota(parts.begin(), parts.end(), 0);
+    
+    vector<vector<BatchWord>> document_words(document_count);
+    vector<double> inv_word_counts(document_count);
+    vector<vector<BatchPosting>> part_postings(part_count);
+    vector<exception_ptr> part_errors(part_count);
+    
+    for_each(execution::par, parts.begin(), parts.end(),
+        [&](size_t part) {
+            const size_t first = document_count * part / part_count;
+            const size_t last = document_count * (part + 1) / part_count;
+            auto& postings = part_postings[part];
+            vector<string_view> words;
+            vector<pair<string_view, uint32_t>> positioned_words;
+            
+            try {
+                for (size_t i = first; i < last; ++i) {
+                    SplitIntoWordsNoStop(documents[i].text, words);
+                    inv_word_counts[i] = 1.0 / words.size();
+                    
+                    positioned_words.clear();
+                    for (size_t position = 0; position < words.size(); ++position) {
+                        positioned_words.emplace_back(words[position], static_cast<uint32_t>(position));
+                    }
+                    sort(positioned_words.begin(), positioned_words.end());
+                    
+                    auto& batch_words = document_words[i];
+                    for (size_t j = 0; j < positioned_words.size();) {
+                        size_t k = j;
+                        while (k < positioned_words.size() && positioned_words[k].first == positioned_words[j].first) {
+                            ++k;
+                        }
+                        batch_words.push_back({positioned_words[j].first, static_cast<uint32_t>(k - j), 
+                            positioned_words[j].second});
+                        j = k;
+                    }
+                    
+                    const int ordinal = first_ordinal + static_cast<int>(i);
+                    for (const BatchWord& batch_word : batch_words) {
+                        postings.push_back({batch_word.word, ordinal, batch_word.count, 
+                            batch_word.first_position});
+                    }
+                }
+                
+                // документы части идут по возрастанию номеров
+                stable_sort(postings.begin(), postings.end(), 
+                    [](const BatchPosting& lhs, const BatchPosting& rhs) {
+                        return lhs.word < rhs.word;
+                    }
+                );
+            } catch (...) {
+                part_errors[part] = current_exception();
+            }
+        }
+    );
+    
+    for (const exception_ptr& error : part_errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    
+    vector<string_view> words;
+    for (const auto& postings : part_postings) {
+        for (size_t i = 0; i < postings.size(); ++i) {
+            if (i == 0 || postings[i].word != postings[i - 1].word) {
+                words.push_back(postings[i].word);
+            }
+        }
+    }
+    sort(execution::par, words.begin(), words.end());
+    words.erase(unique(words.begin(), words.end()), words.end());
+    
+    vector<BatchTerm> terms(words.size());
+    for_each(execution::par, terms.begin(), terms.end(),
+        [&](BatchTerm& term) {
+            term.word = words[&term - terms.data()];
+            const auto it = term_ids_.find(term.word);
+            if (it != term_ids_.end()) {
+                term.is_known = true;
+                term.term_id = it->second;
+            }
+        }
+    );
+    
+    ForEachBatchPosting(terms, part_postings, part_count, 
+        [](BatchTerm& term, const BatchPosting& posting) {
+            if (term.document_count++ == 0) {
+                term.first_ordinal = posting.ordinal;
+                term.first_position = posting.first_position;
+            }
+        }
+    );
+    
+    // новые слова получают номера в порядке первого вхождения, как при
+    // добавлении документов по одному
+    vector<BatchTerm*> new_terms;
+    for (BatchTerm& term : terms) {
+        if (!term.is_known) {
+            new_terms.push_back(&term);
+        }
+    }
+    sort(new_terms.begin(), new_terms.end(), 
+        [](const BatchTerm* lhs, const BatchTerm* rhs) {
+            return tie(lhs->first_ordinal, lhs->first_position) 
+                < tie(rhs->first_ordinal, rhs->first_position);
+        }
+    );
+    for (BatchTerm* term : new_terms) {
+        term->term_id = GetOrAddTermId(term->word);
+    }
+    
+    size_t posting_count = 0;
+    for (BatchTerm& term : terms) {
+        document_freqs_[term.term_id] += term.document_count;
+        term.postings = &active_segment_.GetPostingsForUpdate(term.term_id);
+        posting_count += term.document_count;
+    }
+    
+    // постинги разных слов заполняются независимо
+    ForEachBatchPosting(terms, part_postings, part_count, 
+        [&](BatchTerm& term, const BatchPosting& posting) {
+            term.postings->Insert(posting.ordinal, posting.count, 
+                posting.count * inv_word_counts[posting.ordinal - first_ordinal]);
+        }
+    );
+    active_segment_.AddPostingCount(posting_count);
+    active_segment_.ExtendTo(first_ordinal + static_cast<int>(document_count));
+    
+    vector<vector<DocumentTerm>> document_terms(document_count);
+    for_each(execution::par, parts.begin(), parts.end(),
+        [&](size_t part) {
+            const size_t first = document_count * part / part_count;
+            const size_t last = document_count * (part + 1) / part_count;
+            for (size_t i = first; i < last; ++i) {
+                auto& terms = document_terms[i];
+                terms.reserve(document_words[i].size());
+                for (const BatchWord& batch_word : document_words[i]) {
+                    terms.push_back({term_ids_.find(batch_word.word)->second, batch_word.count});
+                }
+                sort(terms.begin(), terms.end(), 
+                    [](const DocumentTerm& lhs, const DocumentTerm& rhs) {
+                        return lhs.term_id < rhs.term_id;
+                    }
+                );
+            }
+        }
+    );
+    
+    for (size_t i = 0; i < document_count; ++i) {
+        const NewDocument& document = documents[i];
+        auto& terms = document_terms[i];
+        document_terms_.push_back({terms.data(), terms.data() + terms.size()});
+        document_term_storage_.push_back(move(terms));
+        word_frequencies_.emplace_back();
+        documents_.push_back(DocumentData{document.id, ComputeAverageRating(document.ratings), 
+            document.status, inv_word_counts[i]});
+        document_ordinals_.emplace(document.id, first_ordinal + static_cast<int>(i));
+        document_ids_.insert(document.id);
+    }
+    
+    if (active_segment_.GetPostingCount() >= SEGMENT_POSTING_LIMIT) {
+        SealActiveSegment();
+    }
+    ++index_version_;
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    const QueryContext::ThreadLease lease;
+    QueryContext& context = lease.Get();
+    ParseQuery(raw_query, context.query_, context.words_);
+    string key;
+    if (result_cache_) {
+        key = MakeResultCacheKey(context.query_, status, top_k, evaluation);
+        vector<Document> result;
+        if (result_cache_->Find(key, index_version_, result)) {
+            return result;
+        }
+    }
+    
+    ResolveQuery(context.query_, context.resolved_query_);
+    ExecuteQuery(execution::seq, context, context.resolved_query_, 
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        }, 
+        top_k, evaluation);
+    if (result_cache_) {
+        result_cache_->Insert(move(key), index_version_, context.result_);
+    }
+    return context.result_;
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, 
+    DocumentStatus status, size_t top_k) const {
+    
+    return FindTopDocuments(raw_query, status, top_k, QueryEvaluation::EXHAUSTIVE);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query, 
     DocumentStatus status) const {
     
-    return FindTopDocuments(execution::seq, raw_query, status);
+    return FindTopDocuments(raw_query, status, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
-    return FindTopDocuments(execution::seq, raw_query);
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+SearchServer::PreparedQuery SearchServer::PrepareQuery(string_view raw_query) const {
+    auto resolved_query = make_shared<ResolvedQuery>();
+    ResolveQuery(ParseQuery(raw_query), *resolved_query);
+    return PreparedQuery(*this, raw_query, move(resolved_query));
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& prepared_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(execution::seq, prepared_query, status, top_k, evaluation);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& prepared_query, 
+    DocumentStatus status) const {
+    
+    return FindTopDocuments(prepared_query, status, MAX_RESULT_DOCUMENT_COUNT, 
+        QueryEvaluation::EXHAUSTIVE);
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& prepared_query) const {
+    return FindTopDocuments(prepared_query, DocumentStatus::ACTUAL);
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    string_view raw_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(context, raw_query, 
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        }, 
+        top_k, evaluation
+    );
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    string_view raw_query) const {
+    
+    return FindTopDocuments(context, raw_query, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT, 
+        QueryEvaluation::EXHAUSTIVE);
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    const PreparedQuery& prepared_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(context, prepared_query, 
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        }, 
+        top_k, evaluation
+    );
+}
+
+const vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    const PreparedQuery& prepared_query) const {
+    
+    return FindTopDocuments(context, prepared_query, DocumentStatus::ACTUAL, 
+        MAX_RESULT_DOCUMENT_COUNT, QueryEvaluation::EXHAUSTIVE);
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const vector<string_view>& raw_queries) const {
+    
+    return FindTopDocumentsBatch(raw_queries, DocumentStatus::ACTUAL, MAX_RESULT_DOCUMENT_COUNT);
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(
+    const vector<string_view>& raw_queries, DocumentStatus status, size_t top_k) const {
+    
+    // записей в общих массивах постингов на пакет не больше стольких,
+    // остальные постинги каждый запрос обходит сам
+    constexpr size_t MAX_SHARED_POSTING_COUNT = 1 << 23;
+    
+    vector<Query> queries(raw_queries.size());
+    vector<exception_ptr> errors(raw_queries.size());
+    vector<size_t> positions(raw_queries.size());
+    iota(positions.begin(), positions.end(), 0);
+    for_each(execution::par, positions.begin(), positions.end(),
+        [&](size_t i) {
+            vector<string_view> words;
+            try {
+                ParseQuery(raw_queries[i], queries[i], words);
+            } catch (...) {
+                errors[i] = current_exception();
+            }
+        }
+    );
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+    
+    // слова разобранного запроса отсортированы, так что запросы, которые
+    // отличаются только порядком и повторами слов, тоже совпадают
+    const auto get_words = [&queries](size_t i) {
+        return tie(queries[i].plus_words, queries[i].minus_words);
+    };
+    sort(positions.begin(), positions.end(), 
+        [&](size_t lhs, size_t rhs) {
+            return get_words(lhs) < get_words(rhs);
+        }
+    );
+    vector<size_t> unique_queries;
+    vector<size_t> query_to_unique(raw_queries.size());
+    for (size_t j = 0; j < positions.size(); ++j) {
+        if (j == 0 || get_words(positions[j - 1]) != get_words(positions[j])) {
+            unique_queries.push_back(positions[j]);
+        }
+        query_to_unique[positions[j]] = unique_queries.size() - 1;
+    }
+    
+    // запросы, выдача которых нашлась в кеше, дальше не участвуют
+    vector<vector<Document>> unique_results(unique_queries.size());
+    vector<string> cache_keys(unique_queries.size());
+    vector<char> is_cached(unique_queries.size(), false);
+    positions.resize(unique_queries.size());
+    iota(positions.begin(), positions.end(), 0);
+    if (result_cache_) {
+        for_each(execution::par, positions.begin(), positions.end(),
+            [&](size_t i) {
+                cache_keys[i] = MakeResultCacheKey(queries[unique_queries[i]], status, top_k, 
+                    QueryEvaluation::EXHAUSTIVE);
+                is_cached[i] = result_cache_->Find(cache_keys[i], index_version_, unique_results[i]);
+            }
+        );
+    }
+    
+    vector<ResolvedQuery> resolved_queries(unique_queries.size());
+    for_each(execution::par, positions.begin(), positions.end(),
+        [&](size_t i) {
+            if (!is_cached[i]) {
+                ResolveQuery(queries[unique_queries[i]], resolved_queries[i]);
+            }
+        }
+    );
+    
+    // Записи неудалённых документов с нужным статусом. Минус-словам
+    // достаточно тех же записей: документ без них в накопитель и так не
+    // попадёт
+    struct SharedPostings {
+        const PostingList* postings;
+        size_t use_count = 0;
+        bool is_selected = false;
+        vector<int> ordinals;
+        // count * inv_word_count, как при обходе постингов запросом
+        vector<double> term_freqs;
+    };
+    unordered_map<const PostingList*, SharedPostings> shared_postings;
+    for (const ResolvedQuery& resolved_query : resolved_queries) {
+        for (const auto* postings_list : {&resolved_query.plus_postings, &resolved_query.minus_postings}) {
+            for (const PostingList* postings : *postings_list) {
+                if (postings != nullptr) {
+                    SharedPostings& shared = shared_postings[postings];
+                    shared.postings = postings;
+                    ++shared.use_count;
+                }
+            }
+        }
+    }
+    
+    // общими становятся постинги с наибольшей экономией, пока хватает места
+    vector<SharedPostings*> candidates;
+    for (auto& [postings, shared] : shared_postings) {
+        if (shared.use_count > 1) {
+            candidates.push_back(&shared);
+        }
+    }
+    sort(candidates.begin(), candidates.end(),
+        [](const SharedPostings* lhs, const SharedPostings* rhs) {
+            return (lhs->use_count - 1) * lhs->postings->Size() 
+                > (rhs->use_count - 1) * rhs->postings->Size();
+        }
+    );
+    vector<SharedPostings*> selected;
+    size_t shared_posting_count = 0;
+    for (SharedPostings* shared : candidates) {
+        if (shared_posting_count + shared->postings->Size() <= MAX_SHARED_POSTING_COUNT) {
+            shared_posting_count += shared->postings->Size();
+            shared->is_selected = true;
+            selected.push_back(shared);
+        }
+    }
+    for_each(execution::par, selected.begin(), selected.end(),
+        [&](SharedPostings* shared) {
+            shared->ordinals.reserve(shared->postings->Size());
+            shared->term_freqs.reserve(shared->postings->Size());
+            shared->postings->ForEach([&](int ordinal, uint32_t count) {
+                const DocumentData& document_data = documents_[ordinal];
+                if (!document_data.is_removed && document_data.status == status) {
+                    shared->ordinals.push_back(ordinal);
+                    shared->term_freqs.push_back(count * document_data.inv_word_count);
+                }
+            });
+        }
+    );
+    const auto find_shared = [&](const PostingList* postings) -> const SharedPostings* {
+        const SharedPostings& shared = shared_postings.find(postings)->second;
+        return shared.is_selected ? &shared : nullptr;
+    };
+    
+    // релевантность каждого документа складывается в том же порядке, что и
+    // в FindAllDocuments, поэтому выдача совпадает до бита
+    for_each(execution::par, positions.begin(), positions.end(),
+        [&](size_t i) {
+            if (is_cached[i]) {
+                return;
+            }
+            const ResolvedQuery& query = resolved_queries[i];
+            const QueryContext::ThreadLease lease;
+            QueryContext& context = lease.Get();
+            ScoreAccumulator& accumulator = context.accumulator_;
+            accumulator.Reset(documents_.size());
+            
+            for (const PostingList* postings : query.minus_postings) {
+                if (const SharedPostings* shared = find_shared(postings)) {
+                    for (const int ordinal : shared->ordinals) {
+                        accumulator.Exclude(ordinal);
+                    }
+                } else {
+                    postings->ForEach([&accumulator](int ordinal, uint32_t) {
+                        accumulator.Exclude(ordinal);
+                    });
+                }
+            }
+            
+            for (size_t term = 0; term < query.plus_terms.size(); ++term) {
+                const double inverse_document_freq = query.plus_terms[term].inverse_document_freq;
+                for (size_t segment = 0; segment < query.segment_count; ++segment) {
+                    const PostingList* postings = query.GetPostings(term, segment);
+                    if (postings == nullptr) {
+                        continue;
+                    }
+                    if (const SharedPostings* shared = find_shared(postings)) {
+                        for (size_t k = 0; k < shared->ordinals.size(); ++k) {
+                            const int ordinal = shared->ordinals[k];
+                            if (!accumulator.IsExcluded(ordinal)) {
+                                accumulator.Add(ordinal, shared->term_freqs[k] * inverse_document_freq);
+                            }
+                        }
+                        continue;
+                    }
+                    postings->ForEach([&](int ordinal, uint32_t count) {
+                        if (accumulator.IsExcluded(ordinal)) {
+                            return;
+                        }
+                        const DocumentData& document_data = documents_[ordinal];
+                        if (!document_data.is_removed && document_data.status == status) {
+                            accumulator.Add(ordinal, 
+                                count * document_data.inv_word_count * inverse_document_freq);
+                        }
+                    });
+                }
+            }
+            
+            TopDocuments& top_documents = context.top_documents_;
+            top_documents.Reset(top_k);
+            for (const int ordinal : accumulator.GetTouched()) {
+                const DocumentData& document_data = documents_[ordinal];
+                top_documents.Push({document_data.id, accumulator.GetScore(ordinal), 
+                    document_data.rating});
+            }
+            top_documents.ExtractTo(unique_results[i]);
+            if (result_cache_) {
+                result_cache_->Insert(move(cache_keys[i]), index_version_, unique_results[i]);
+            }
+        }
+    );
+    
+    vector<vector<Document>> results(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        results[i] = unique_results[query_to_unique[i]];
+    }
+    return results;
 }
 
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return static_cast<int>(document_ids_.size());
+}
+
+void SearchServer::RefreshImpactOrder() {
+    PollMerge();
+    impact_postings_.resize(terms_.size());
+    
+    vector<TermId> term_ids(terms_.size());
+    iota(term_ids.begin(), term_ids.end(), 0);
+    
+    for_each(execution::par, term_ids.begin(), term_ids.end(),
+        [this] (TermId term_id) {
+            auto& impacts = impact_postings_[term_id];
+            impacts.clear();
+            impacts.reserve(document_freqs_[term_id]);
+            ForEachSegment([&](const IndexSegment& segment) {
+                const PostingList* postings = segment.FindPostings(term_id);
+                if (postings == nullptr) {
+                    return;
+                }
+                postings->ForEach([&](int ordinal, uint32_t count) {
+                    if (!documents_[ordinal].is_removed) {
+                        impacts.push_back({ordinal, count});
+                    }
+                });
+            });
+            
+            sort(impacts.begin(), impacts.end(), 
+                [this] (const ImpactPosting& lhs, const ImpactPosting& rhs) {
+                    const double lhs_term_freq = lhs.count * documents_[lhs.ordinal].inv_word_count;
+                    const double rhs_term_freq = rhs.count * documents_[rhs.ordinal].inv_word_count;
+                    if (lhs_term_freq != rhs_term_freq) {
+                        return lhs_term_freq > rhs_term_freq;
+                    }
+                    return lhs.ordinal < rhs.ordinal;
+                }
+            );
+            impacts.shrink_to_fit();
+        }
+    );
+    
+    impact_watermark_ = static_cast<int>(documents_.size());
+    ++index_version_;
+}
+
+void SearchServer::SetImpactAccuracy(double accuracy) {
+    if (!(accuracy > 0.0 && accuracy <= 1.0)) {
+        throw invalid_argument("Impact accuracy must be in (0, 1]"s);
+    }
+    impact_accuracy_ = accuracy;
+    ++index_version_;
+}
+
+void SearchServer::SetResultCacheCapacity(size_t max_bytes) {
+    result_cache_ = max_bytes > 0 ? make_unique<QueryResultCache>(max_bytes) : nullptr;
+}
+
+QueryResultCache::Stats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : QueryResultCache::Stats{};
+}
+
+void SearchServer::WaitForMerges() {
+    // подключение слияния может запустить следующее
+    while (merge_.valid()) {
+        merge_.wait();
+        InstallMerge();
+    }
 }
 
 SearchServer::MatchResult SearchServer::MatchDocument(string_view raw_query,
@@ -64,17 +717,7 @@ SearchServer::MatchResult SearchServer::MatchDocument(string_view raw_query,
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (document_ids_.count(document_id) == 0) {
-        return;
-    }
-   
-    for (const auto& [word, _] : doc_to_words_freq_.at(document_id)) {
-        word_to_document_freqs_.at(string(word)).erase(document_id);
-    }
-    
-    documents_.erase(document_id);
-    document_ids_.erase(document_id);
-    doc_to_words_freq_.erase(document_id);
+    RemoveDocuments({document_id}, false);
 }
 
 void SearchServer::RemoveDocument(execution::sequenced_policy, int document_id) {
@@ -82,39 +725,134 @@ void SearchServer::RemoveDocument(execution::sequenced_policy, int document_id)
 }
 
 void SearchServer::RemoveDocument(execution::parallel_policy, int document_id) {
-    if (document_ids_.count(document_id) == 0) {
+    // слов одного документа слишком мало, чтобы делить их между потоками
+    RemoveDocument(document_id);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(document_ids, false);
+}
+
+void SearchServer::RemoveDocuments(execution::sequenced_policy, const vector<int>& document_ids) {
+    RemoveDocuments(document_ids, false);
+}
+
+void SearchServer::RemoveDocuments(execution::parallel_policy, const vector<int>& document_ids) {
+    RemoveDocuments(document_ids, true);
+}
+
+void SearchServer::RemoveDocuments(const vector<int>& document_ids, bool parallel) {
+    PollMerge();
+    
+    // порядковые номера не переиспользуются, от документа остаются только
+    // атрибуты, а записи в постингах остаются до слияния его сегмента
+    vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        const auto ordinal_it = document_ordinals_.find(document_id);
+        if (ordinal_it == document_ordinals_.end()) {
+            continue;
+        }
+        ordinals.push_back(ordinal_it->second);
+        documents_[ordinal_it->second].is_removed = true;
+        document_ordinals_.erase(ordinal_it);
+        document_ids_.erase(document_id);
+    }
+    if (ordinals.empty()) {
         return;
     }
+    sort(ordinals.begin(), ordinals.end());
     
-    const auto& word_freqs = GetWordFrequencies(document_id);
-
-    vector<string_view> words(word_freqs.size());
+    vector<TermId> empty_terms;
+    if (parallel) {
+        // Каждый блок номеров слов двоичным поиском находит свои слова в
+        // прямом индексе удаляемых документов, так что блоки меняют разные
+        // счётчики и не мешают друг другу
+        constexpr size_t BLOCKS_PER_THREAD = 4;
+        const size_t block_count = min(terms_.size(), 
+            max(1u, thread::hardware_concurrency()) * BLOCKS_PER_THREAD);
+        vector<size_t> blocks(block_count);
+        iota(blocks.begin(), blocks.end(), 0);
+        vector<vector<TermId>> block_empty_terms(block_count);
+        
+        for_each(execution::par, blocks.begin(), blocks.end(),
+            [&](size_t block) {
+                const TermId first = static_cast<TermId>(terms_.size() * block / block_count);
+                const TermId last = static_cast<TermId>(terms_.size() * (block + 1) / block_count);
+                for (const int ordinal : ordinals) {
+                    const DocumentTermRange terms = document_terms_[ordinal];
+                    auto term = lower_bound(terms.begin(), terms.end(), first,
+                        [](const DocumentTerm& term, TermId term_id) {
+                            return term.term_id < term_id;
+                        });
+                    for (; term != terms.end() && term->term_id < last; ++term) {
+                        if (--document_freqs_[term->term_id] == 0) {
+                            block_empty_terms[block].push_back(term->term_id);
+                        }
+                    }
+                }
+            }
+        );
+        for (const auto& terms : block_empty_terms) {
+            empty_terms.insert(empty_terms.end(), terms.begin(), terms.end());
+        }
+    } else {
+        for (const int ordinal : ordinals) {
+            for (const DocumentTerm& term : document_terms_[ordinal]) {
+                if (--document_freqs_[term.term_id] == 0) {
+                    empty_terms.push_back(term.term_id);
+                }
+            }
+        }
+    }
     
-    transform(execution::par, word_freqs.begin(), word_freqs.end(), words.begin(),
-        [] (const auto& word_freq) {
-           return word_freq.first;
+    // Постинги слов без документов содержат только удалённые документы.
+    // Запечатанные сегменты неизменяемы, из них такие постинги пропадут при
+    // слиянии; слово остаётся в словаре под прежним номером
+    for (const TermId term_id : empty_terms) {
+        active_segment_.ErasePostings(term_id);
+        if (term_id < impact_postings_.size()) {
+            impact_postings_[term_id] = {};
         }
-    );
-       
-    for_each(execution::par, words.begin(), words.end(), 
-        [this, document_id] (string_view word) {
-            word_to_document_freqs_.at(string(word)).erase(document_id);
+    }
+    
+    if (parallel) {
+        for_each(execution::par, ordinals.begin(), ordinals.end(),
+            [this](int ordinal) {
+                ClearDocumentTerms(ordinal);
+            }
+        );
+    } else {
+        for (const int ordinal : ordinals) {
+            ClearDocumentTerms(ordinal);
         }
-    );
+    }
     
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
-    doc_to_words_freq_.erase(document_id);
+    MarkRemovedInSegments(ordinals);
+    ++index_version_;
 }
 
 const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
     static const map<string_view, double> empty;
 
-    if (documents_.count(document_id) == 0) {
+    const auto ordinal_it = document_ordinals_.find(document_id);
+    if (ordinal_it == document_ordinals_.end()) {
         return empty;
     }
     
-    return doc_to_words_freq_.at(document_id);
+    const int ordinal = ordinal_it->second;
+    const lock_guard guard(*word_frequencies_mutex_);
+    auto& word_frequencies = word_frequencies_[ordinal];
+    if (!word_frequencies) {
+        auto result = make_unique<map<string_view, double>>();
+        const double inv_word_count = documents_[ordinal].inv_word_count;
+        for (const DocumentTerm& term : document_terms_[ordinal]) {
+            result->emplace(terms_[term.term_id], term.count * inv_word_count);
+        }
+        word_frequencies = move(result);
+    }
+    
+    return *word_frequencies;
 }
 
 set<int>::const_iterator SearchServer::begin() const {
@@ -126,7 +864,7 @@ set<int>::const_iterator SearchServer::end() const {
 }
 
 bool SearchServer::IsStopWord(string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(string_view word) {
@@ -135,24 +873,18 @@ bool SearchServer::IsValidWord(string_view word) {
     });
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words = SplitIntoWords(text);
-    vector<string_view> words_no_stop;
-    words_no_stop.reserve(words.size());
-
-    for_each(words.begin(), words.end(),
-        [this, &words_no_stop](string_view &word) {
-            if (stop_words_.count(word) == 0) {
-                if (!IsValidWord(word)) {
-                    throw invalid_argument("not valid"s);
-                }
-                
-                words_no_stop.push_back(word);
-            }
-        }
-    );
+void SearchServer::SplitIntoWordsNoStop(string_view text, vector<string_view>& words) const {
+    // стоп-слова проверены в конструкторе, поэтому управляющий символ
+    // где угодно в тексте означает ошибочное слово
+    if (!SplitIntoValidWords(text, words)) {
+        throw invalid_argument("not valid"s);
+    }
     
-    return words_no_stop;
+    words.erase(remove_if(words.begin(), words.end(),
+        [this](string_view word) {
+            return IsStopWord(word);
+        }),
+        words.end());
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
@@ -165,7 +897,7 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
         return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text, bool has_valid_chars) const {
     if (text.empty()) {
         throw invalid_argument("Query word is empty"s);
     }
@@ -178,7 +910,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view text) const {
         word = word.substr(1);
     }
     
-    if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+    if (word.empty() || word[0] == '-' || (!has_valid_chars && !IsValidWord(word))) {
         throw invalid_argument("Query word "s + string(text)+ " is invalid");
     }
 
@@ -190,8 +922,10 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool parallel) co
     result.is_parallel = parallel;
     
     if (parallel) {
-        for (const string_view& word : SplitIntoWords(text)) {
-            const auto query_word = ParseQueryWord(word);
+        vector<string_view> words;
+        const bool has_valid_chars = SplitIntoValidWords(text, words);
+        for (const string_view& word : words) {
+            const auto query_word = ParseQueryWord(word, has_valid_chars);
             if (!query_word.is_stop) {
                 if (query_word.is_minus) {
                     result.minus_words.push_back(query_word.data);
@@ -204,28 +938,402 @@ SearchServer::Query SearchServer::ParseQuery(string_view text, bool parallel) co
         return result;
     }
     
-    // дублирование циклов for, но так более эффективно, чем добавлять в вектор 
-    // с дубликатами, а затем перекладывать в set и обратно
-    
-    set<string_view> plus_words;
-    set<string_view> minus_words;
+    vector<string_view> words;
+    ParseQuery(text, result, words);
     
-    for (const string_view& word : SplitIntoWords(text)) {
-         const auto query_word = ParseQueryWord(word);
+    return result;
+}
 
+void SearchServer::ParseQuery(string_view text, Query& result, 
+    vector<string_view>& words) const {
+    
+    result.plus_words.clear();
+    result.minus_words.clear();
+    result.is_parallel = false;
+    
+    const bool has_valid_chars = SplitIntoValidWords(text, words);
+    for (const string_view& word : words) {
+        const auto query_word = ParseQueryWord(word, has_valid_chars);
         if (!query_word.is_stop) {
             query_word.is_minus ? 
-                minus_words.insert(query_word.data) : 
-                plus_words.insert(query_word.data);
+                result.minus_words.push_back(query_word.data) : 
+                result.plus_words.push_back(query_word.data);
         }
     }
     
-    result.plus_words.assign(plus_words.begin(), plus_words.end());
-    result.minus_words.assign(minus_words.begin(), minus_words.end());
+    // сортировка с удалением повторов вместо set не выделяет память на узлы
+    for (auto* query_words : {&result.plus_words, &result.minus_words}) {
+        sort(query_words->begin(), query_words->end());
+        query_words->erase(unique(query_words->begin(), query_words->end()), query_words->end());
+    }
+}
+
+string SearchServer::MakeResultCacheKey(const Query& query, DocumentStatus status, 
+    size_t top_k, QueryEvaluation evaluation) {
+    
+    string key;
+    for (const string_view word : query.plus_words) {
+        key += word;
+        key += ' ';
+    }
+    // минус-слова отделены управляющим символом, которого нет в словах
+    key += '\x01';
+    for (const string_view word : query.minus_words) {
+        key += word;
+        key += ' ';
+    }
+    key += '\x01';
+    key += to_string(static_cast<int>(status));
+    key += ' ';
+    key += to_string(top_k);
+    key += ' ';
+    key += to_string(static_cast<int>(evaluation));
+    return key;
+}
+
+int SearchServer::GetOrdinal(int document_id) const {
+    const auto it = document_ordinals_.find(document_id);
+    if (it == document_ordinals_.end()) {
+        throw out_of_range("no such id"s);
+    }
     
-    return result;
+    return it->second;
+}
+
+const SearchServer::DocumentTerm* SearchServer::FindDocumentTerm(int ordinal, TermId term_id) const {
+    const DocumentTermRange terms = document_terms_[ordinal];
+    const DocumentTerm* it = lower_bound(terms.first, terms.last, term_id,
+        [](const DocumentTerm& term, TermId term_id) {
+            return term.term_id < term_id;
+        });
+    if (it == terms.last || it->term_id != term_id) {
+        return nullptr;
+    }
+    
+    return it;
+}
+
+void SearchServer::ClearDocumentTerms(int ordinal) {
+    document_terms_[ordinal] = {};
+    document_term_storage_[ordinal] = {};
+    word_frequencies_[ordinal].reset();
+}
+
+SearchServer::TermId SearchServer::GetOrAddTermId(string_view word) {
+    const auto it = term_ids_.find(word);
+    if (it != term_ids_.end()) {
+        return it->second;
+    }
+    
+    const TermId term_id = static_cast<TermId>(terms_.size());
+    term_storage_.emplace_back(word);
+    terms_.push_back(term_storage_.back());
+    document_freqs_.push_back(0);
+    term_ids_.emplace(terms_.back(), term_id);
+    
+    return term_id;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(TermId term_id) const {
+    return log(GetDocumentCount() * 1.0 / document_freqs_[term_id]);
+}
+
+size_t SearchServer::GetDocumentFrequency(string_view word) const {
+    const auto it = term_ids_.find(word);
+    if (it == term_ids_.end()) {
+        return 0;
+    }
+    
+    return document_freqs_[it->second];
+}
+
+void SearchServer::ResolveQuery(const Query& query, ResolvedQuery& result) const {
+    result.index_version = index_version_;
+    result.segment_count = sealed_segments_.size() + 1;
+    result.plus_terms.clear();
+    result.plus_postings.clear();
+    result.minus_postings.clear();
+    
+    for (string_view word : query.plus_words) {
+        const auto it = term_ids_.find(word);
+        if (it == term_ids_.end() || document_freqs_[it->second] == 0) {
+            continue;
+        }
+        const TermId term_id = it->second;
+        result.plus_terms.push_back({it->first, term_id, ComputeWordInverseDocumentFreq(term_id)});
+        ForEachSegment([&](const IndexSegment& segment) {
+            result.plus_postings.push_back(segment.FindPostings(term_id));
+        });
+    }
+    
+    for (string_view word : query.minus_words) {
+        const auto it = term_ids_.find(word);
+        if (it == term_ids_.end() || document_freqs_[it->second] == 0) {
+            continue;
+        }
+        ForEachSegment([&](const IndexSegment& segment) {
+            if (const PostingList* postings = segment.FindPostings(it->second)) {
+                result.minus_postings.push_back(postings);
+            }
+        });
+    }
+}
+
+void SearchServer::SealActiveSegment() {
+    const int first_ordinal = active_segment_.GetFirstOrdinal();
+    const int end_ordinal = active_segment_.GetEndOrdinal();
+    int removed_count = 0;
+    for (int ordinal = first_ordinal; ordinal < end_ordinal; ++ordinal) {
+        removed_count += documents_[ordinal].is_removed;
+    }
+    
+    sealed_segments_.push_back({make_shared<const IndexSegment>(move(active_segment_)), 
+        end_ordinal - first_ordinal, removed_count});
+    active_segment_ = IndexSegment(end_ordinal);
+    ScheduleMerge();
+}
+
+void SearchServer::MarkRemovedInSegments(const vector<int>& ordinals) {
+    // документы активного сегмента вычищаются уже после его запечатывания
+    auto it = sealed_segments_.begin();
+    for (const int ordinal : ordinals) {
+        while (it != sealed_segments_.end() && ordinal >= it->segment->GetEndOrdinal()) {
+            ++it;
+        }
+        if (it == sealed_segments_.end()) {
+            break;
+        }
+        if (ordinal >= it->segment->GetFirstOrdinal()) {
+            ++it->removed_count;
+        }
+    }
+    
+    ScheduleMerge();
+}
+
+void SearchServer::ScheduleMerge() {
+    if (merge_.valid() || sealed_segments_.empty()) {
+        return;
+    }
+    
+    // Уровень сегмента — сколько раз его размер превышает SEGMENT_POSTING_LIMIT
+    // в MERGE_FACTOR раз. MERGE_FACTOR соседних сегментов одного уровня
+    // сливаются в сегмент следующего, так что каждая запись переписывается
+    // O(log) раз. Сегмент, в котором удалено больше половины документов,
+    // переписывается отдельно
+    const auto get_level = [](const IndexSegment& segment) {
+        size_t level = 0;
+        for (size_t size = SEGMENT_POSTING_LIMIT * MERGE_FACTOR; segment.GetPostingCount() >= size; 
+            size *= MERGE_FACTOR) {
+            ++level;
+        }
+        return level;
+    };
+    
+    size_t first = sealed_segments_.size();
+    size_t count = 0;
+    for (size_t i = 0; i + MERGE_FACTOR <= sealed_segments_.size() && count == 0; ++i) {
+        const size_t level = get_level(*sealed_segments_[i].segment);
+        size_t j = i + 1;
+        while (j < i + MERGE_FACTOR && get_level(*sealed_segments_[j].segment) == level) {
+            ++j;
+        }
+        if (j == i + MERGE_FACTOR) {
+            first = i;
+            count = MERGE_FACTOR;
+        }
+    }
+    for (size_t i = 0; i < sealed_segments_.size() && count == 0; ++i) {
+        if (sealed_segments_[i].removed_count * 2 > sealed_segments_[i].document_count) {
+            first = i;
+            count = 1;
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    
+    // слиянию достаются неизменяемые сегменты и копии нужных атрибутов,
+    // так что сервер можно менять, пока оно идёт
+    vector<shared_ptr<const IndexSegment>> segments;
+    for (size_t i = first; i < first + count; ++i) {
+        segments.push_back(sealed_segments_[i].segment);
+    }
+    const int first_ordinal = segments.front()->GetFirstOrdinal();
+    const int end_ordinal = segments.back()->GetEndOrdinal();
+    vector<bool> is_removed(end_ordinal - first_ordinal);
+    vector<double> inv_word_counts(end_ordinal - first_ordinal);
+    for (int ordinal = first_ordinal; ordinal < end_ordinal; ++ordinal) {
+        is_removed[ordinal - first_ordinal] = documents_[ordinal].is_removed;
+        inv_word_counts[ordinal - first_ordinal] = documents_[ordinal].inv_word_count;
+    }
+    
+    merge_first_ = first;
+    merge_count_ = count;
+    merge_ = async(launch::async, 
+        [segments = move(segments), is_removed = move(is_removed), 
+            inv_word_counts = move(inv_word_counts)]() mutable {
+            
+            vector<const IndexSegment*> sources;
+            for (const auto& segment : segments) {
+                sources.push_back(segment.get());
+            }
+            auto merged = make_shared<const IndexSegment>(
+                IndexSegment::Merge(sources, is_removed, inv_word_counts));
+            return MergeResult{move(merged), move(is_removed)};
+        });
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+void SearchServer::PollMerge() {
+    if (merge_.valid() && merge_.wait_for(chrono::seconds(0)) == future_status::ready) {
+        InstallMerge();
+    }
+}
+
+void SearchServer::InstallMerge() {
+    MergeResult result = merge_.get();
+    const int first_ordinal = result.segment->GetFirstOrdinal();
+    const int end_ordinal = result.segment->GetEndOrdinal();
+    
+    // документы, удалённые во время слияния, остаются в новом сегменте
+    SealedSegment merged{move(result.segment), 0, 0};
+    for (int ordinal = first_ordinal; ordinal < end_ordinal; ++ordinal) {
+        if (!result.is_removed[ordinal - first_ordinal]) {
+            ++merged.document_count;
+            merged.removed_count += documents_[ordinal].is_removed;
+        }
+    }
+    
+    const auto first = sealed_segments_.begin() + merge_first_;
+    *first = move(merged);
+    sealed_segments_.erase(first + 1, first + merge_count_);
+    
+    // указатели на постинги в сопоставленных запросах устарели
+    ++index_version_;
+    ScheduleMerge();
+}
+
+shared_ptr<const SearchServer::ResolvedQuery> SearchServer::GetResolvedQuery(
+    const PreparedQuery& prepared_query) const {
+    
+    if (prepared_query.search_server_ != this) {
+        throw invalid_argument("Query is prepared by another server"s);
+    }
+    
+    auto resolved_query = atomic_load(&prepared_query.resolved_query_);
+    if (resolved_query->index_version != index_version_) {
+        // слова уже проверены при подготовке, разбор повторяется только
+        // ради сопоставления с изменившимся словарём
+        auto updated_query = make_shared<ResolvedQuery>();
+        ResolveQuery(ParseQuery(prepared_query.raw_query_), *updated_query);
+        resolved_query = move(updated_query);
+        atomic_store(&prepared_query.resolved_query_, resolved_query);
+    }
+    
+    return resolved_query;
+}
+
+void SearchServer::ExcludeMinusWords(const ResolvedQuery& query, ScoreAccumulator& accumulator) const {
+    for (const PostingList* postings : query.minus_postings) {
+        postings->ForEach([&accumulator](int ordinal, uint32_t) {
+            accumulator.Exclude(ordinal);
+        });
+    }
+}
+
+double SearchServer::ComputeExactRelevance(const ResolvedQuery& query, int ordinal) const {
+    const double inv_word_count = documents_[ordinal].inv_word_count;
+    double relevance = 0.0;
+    for (const QueryTerm& term : query.plus_terms) {
+        if (const DocumentTerm* document_term = FindDocumentTerm(ordinal, term.term_id)) {
+            relevance += document_term->count * inv_word_count * term.inverse_document_freq;
+        }
+    }
+    return relevance;
+}
+
+void SearchServer::SelectExactTopDocuments(QueryContext& context, const ResolvedQuery& query, 
+    size_t top_k) const {
+    
+    const ScoreAccumulator& accumulator = context.accumulator_;
+    const auto& touched = accumulator.GetTouched();
+    if (top_k == 0 || touched.empty()) {
+        context.result_.clear();
+        return;
+    }
+    
+    vector<double>& scores = context.scores_;
+    scores.clear();
+    for (const int ordinal : touched) {
+        scores.push_back(accumulator.GetScore(ordinal));
+    }
+    const size_t kth = min(top_k, scores.size()) - 1;
+    nth_element(scores.begin(), scores.begin() + kth, scores.end(), greater<double>());
+    
+    // накопленная релевантность отличается от точной не больше чем на ошибку
+    // округления, так что запаса в два допуска сравнения хватает
+    const double cutoff = scores[kth] - 2e-6;
+    
+    TopDocuments& top_documents = context.top_documents_;
+    top_documents.Reset(top_k);
+    for (const int ordinal : touched) {
+        if (accumulator.GetScore(ordinal) >= cutoff) {
+            const auto& document_data = documents_[ordinal];
+            top_documents.Push({document_data.id, ComputeExactRelevance(query, ordinal), 
+                document_data.rating});
+        }
+    }
+    top_documents.ExtractTo(context.result_);
+}
+SearchServer::PreparedQuery::PreparedQuery(const SearchServer& search_server, 
+    string_view raw_query, shared_ptr<const ResolvedQuery> resolved_query)
+    : search_server_(&search_server)
+    , raw_query_(raw_query)
+    , resolved_query_(move(resolved_query)) {
+}
+
+SearchServer::IndexBuilder::IndexBuilder(SearchServer& search_server, size_t batch_size)
+    : search_server_(&search_server)
+    , batch_size_(max<size_t>(batch_size, 1)) {
+}
+
+void SearchServer::IndexBuilder::AddDocument(int document_id, string_view document, 
+    DocumentStatus status, const vector<int>& ratings) {
+    
+    texts_.emplace_back(document);
+    documents_.push_back({document_id, texts_.back(), status, ratings});
+    if (documents_.size() >= batch_size_) {
+        Flush();
+    }
+}
+
+void SearchServer::IndexBuilder::Flush() {
+    // накопитель очищается и тогда, когда пакет отвергнут
+    const vector<NewDocument> documents = move(documents_);
+    const deque<string> texts = move(texts_);
+    documents_.clear();
+    texts_.clear();
+    search_server_->AddDocuments(documents);
+}
+
+namespace {
+
+thread_local vector<unique_ptr<SearchServer::QueryContext>> thread_query_contexts;
+thread_local size_t thread_query_context_depth = 0;
+
+}
+
+SearchServer::QueryContext::ThreadLease::ThreadLease() {
+    if (thread_query_context_depth == thread_query_contexts.size()) {
+        thread_query_contexts.push_back(make_unique<QueryContext>());
+    }
+    context_ = thread_query_contexts[thread_query_context_depth++].get();
+}
+
+SearchServer::QueryContext::ThreadLease::~ThreadLease() {
+    --thread_query_context_depth;
+}
+
+SearchServer::QueryContext& SearchServer::QueryContext::ThreadLease::Get() const {
+    return *context_;
+}
@@ -1,28 +1,71 @@
 #pragma once
-#include "concurrent_map.h"
 #include "document.h"
+#include "index_segment.h"
+#include "postings.h"
+#include "query_result_cache.h"
+#include "score_accumulator.h"
+#include "stop_word_set.h"
 #include "string_processing.h"
+#include "top_documents.h"
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <deque>
 #include <execution>
 #include <functional>
+#include <future>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <stdexcept>
+#include <thread>
 #include <string>
 #include <string_view> 
 #include <set>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
+class MappedFile;
+
+// Способ вычисления запроса в FindTopDocuments
+enum class QueryEvaluation {
+    // все постинги всех слов запроса обходятся целиком
+    EXHAUSTIVE,
+    // обход документ за документом (MaxScore): документ, который по верхним
+    // оценкам вкладов слов не может попасть в текущий top_k, пропускается;
+    // результат совпадает с EXHAUSTIVE
+    DYNAMIC_PRUNING,
+    // обход постингов в порядке убывания вклада (score-at-a-time) по
+    // индексу, построенному RefreshImpactOrder; останавливается, когда
+    // необработанные вклады уже не могут изменить top_k. Точность
+    // регулируется SetImpactAccuracy
+    IMPACT_ORDERED,
+};
+
 class SearchServer {
 public:
     using MatchResult = std::tuple<std::vector<std::string_view>, DocumentStatus>;
     
+    class PreparedQuery;
+    class QueryContext;
+    class IndexBuilder;
+    
+    // Документ для пакетного добавления
+    struct NewDocument {
+        int id;
+        std::string_view text;
+        DocumentStatus status;
+        std::vector<int> ratings;
+    };
+    
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
     explicit SearchServer(std::string_view stop_words_text);
@@ -30,6 +73,45 @@ public:
     
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
     
+    // Добавляет документы пакетом: разбор текстов и построение постингов идут
+    // параллельно, а выдача, частоты слов и словарь получаются те же, что после
+    // AddDocument для каждого документа по порядку. Если хотя бы один документ
+    // ошибочен, не добавляется ни один
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    
+    // Возвращает top_k лучших документов; перегрузки без top_k
+    // возвращают MAX_RESULT_DOCUMENT_COUNT документов
+    // DYNAMIC_PRUNING обходит постинги последовательно при любой политике
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+        DocumentPredicate document_predicate, size_t top_k) const;
+    
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+        DocumentStatus status, size_t top_k) const;
+    
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, 
+        DocumentPredicate document_predicate, size_t top_k) const;
+    
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, 
+        DocumentStatus status, size_t top_k) const;
+    
     template <typename Policy, typename DocumentPredicate>
     std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query, 
         DocumentPredicate document_predicate) const;
@@ -50,7 +132,95 @@ public:
     
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
     
+    // Разбирает запрос и сопоставляет его слова словарю один раз; подготовленный
+    // запрос выполняется многократно с любыми предикатами, в том числе из разных
+    // потоков. После изменения индекса он пересопоставляется при выполнении
+    PreparedQuery PrepareQuery(std::string_view raw_query) const;
+    
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(Policy&& policy, const PreparedQuery& prepared_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    template <typename Policy>
+    std::vector<Document> FindTopDocuments(Policy&& policy, const PreparedQuery& prepared_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const PreparedQuery& prepared_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    std::vector<Document> FindTopDocuments(const PreparedQuery& prepared_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    std::vector<Document> FindTopDocuments(const PreparedQuery& prepared_query, 
+        DocumentStatus status) const;
+    
+    std::vector<Document> FindTopDocuments(const PreparedQuery& prepared_query) const;
+    
+    // Выполняет запрос последовательно, беря память для промежуточных данных и
+    // результата только из буферов context, поэтому после прогрева контекста
+    // запрос не обращается к куче. Результат действителен до следующего
+    // запроса с тем же контекстом
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, std::string_view raw_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, std::string_view raw_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, 
+        std::string_view raw_query) const;
+    
+    template <typename DocumentPredicate>
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, 
+        const PreparedQuery& prepared_query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, 
+        const PreparedQuery& prepared_query, 
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+    
+    const std::vector<Document>& FindTopDocuments(QueryContext& context, 
+        const PreparedQuery& prepared_query) const;
+    
+    // Выполняет пакет запросов параллельно; выдача каждого запроса та же,
+    // что у FindTopDocuments(raw_query, status, top_k). Запросы, одинаковые
+    // после разбора, выполняются один раз. Постинги, нужные нескольким
+    // запросам, обходятся один раз на пакет: записи подходящих документов
+    // с их tf выписываются в массив, по которому затем считают все эти
+    // запросы
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::vector<std::string_view>& raw_queries) const;
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(
+        const std::vector<std::string_view>& raw_queries, 
+        DocumentStatus status, size_t top_k) const;
+    
     int GetDocumentCount() const;
+    
+    // Перестраивает упорядоченные по вкладу постинги для IMPACT_ORDERED.
+    // Документы, добавленные после перестроения, обрабатываются этим режимом
+    // полным обходом, поэтому при активном добавлении вызов нужно повторять
+    void RefreshImpactOrder();
+    
+    // accuracy из (0, 1]: при 1 выдача IMPACT_ORDERED совпадает с EXHAUSTIVE,
+    // при меньших значениях обход останавливается раньше, и документ может не
+    // попасть в выдачу, только если его релевантность превышает релевантность
+    // последнего выданного не более чем на (1 - accuracy) * остаток вкладов
+    void SetImpactAccuracy(double accuracy);
+    
+    // Включает кеш выдач размером до max_bytes байт, 0 — выключает. Кеш
+    // используют последовательные перегрузки FindTopDocuments по тексту
+    // запроса со статусом и FindTopDocumentsBatch; ключ — разобранный запрос (плюс- и минус-слова
+    // без повторов по порядку), статус, top_k и способ вычисления. Любое
+    // изменение индекса делает записи устаревшими. Вызов сбрасывает кеш и
+    // его счётчики и не должен идти одновременно с запросами
+    void SetResultCacheCapacity(size_t max_bytes);
+    // Счётчики кеша выдач; без кеша — нули
+    QueryResultCache::Stats GetResultCacheStats() const;
+    
+    // Дожидается фоновых слияний сегментов индекса и подключает их результат.
+    // Без вызова слияния подключаются при следующих изменениях индекса
+    void WaitForMerges();
        
     template <typename Policy>
     MatchResult MatchDocument(Policy&& policy, std::string_view raw_query,
@@ -65,24 +235,145 @@ public:
     void RemoveDocument(std::execution::sequenced_policy, int document_id);
     void RemoveDocument(std::execution::parallel_policy, int document_id);
     
+    // Удаляет документы пакетом, отсутствующие и повторные id пропускаются.
+    // Документы сразу помечаются удалёнными, счётчики документов слов
+    // обновляются группами по словам (при parallel_policy — параллельно по
+    // блокам слов), у слов без оставшихся документов выбрасываются постинги
+    // активного сегмента и упорядоченные по вкладу. Записи запечатанных
+    // сегментов убирает их фоновое слияние
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void RemoveDocuments(std::execution::sequenced_policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(std::execution::parallel_policy, const std::vector<int>& document_ids);
+    
     std::set<int>::const_iterator begin() const;
     std::set<int>::const_iterator end() const;
     
+    // Сохраняет индекс в файл формата index_file.h; файл заменяется целиком
+    // только после успешной записи. Удалённые документы не сохраняются,
+    // упорядоченные по вкладу постинги тоже: после Open их перестраивает
+    // RefreshImpactOrder
+    void Save(const std::string& path) const;
+    // Открывает сохранённый индекс без разбора: постинги, слова словаря и
+    // прямой индекс читаются прямо из отображённого в память файла, заново
+    // строятся только хеш-таблица словаря и таблицы id документов. Без
+    // проверки контрольных сумм файл не читается целиком при открытии, но
+    // и повреждения в нём не обнаруживаются
+    static SearchServer Open(const std::string& path, bool verify_checksums = true);
+    
 private:
+    friend class ShardedSearchServer;
+    // читают прямой индекс без построения словарей частот
+    friend void RemoveDuplicates(SearchServer& search_server);
+    friend void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold);
+    
     struct DocumentData {
+        int id;
         int rating;
         DocumentStatus status;
+        // tf слова в документе = число вхождений * inv_word_count
+        double inv_word_count;
+        bool is_removed = false;
+    };
+    
+    // запись постингов, упорядоченных по убыванию tf
+    struct ImpactPosting {
+        int ordinal;
+        std::uint32_t count;
+    };
+    
+    using TermId = std::uint32_t;
+    
+    // слово документа, tf = count * inv_word_count
+    struct DocumentTerm {
+        TermId term_id;
+        std::uint32_t count;
+    };
+    
+    // слова документа по возрастанию номера слова
+    struct DocumentTermRange {
+        const DocumentTerm* first = nullptr;
+        const DocumentTerm* last = nullptr;
+        
+        const DocumentTerm* begin() const {
+            return first;
+        }
+        const DocumentTerm* end() const {
+            return last;
+        }
+    };
+    
+    const StopWordSet stop_words_;
+    // строки слов словаря; deque не инвалидирует ссылки при добавлении,
+    // поэтому string_view на них остаются валидными всё время жизни сервера
+    std::deque<std::string> term_storage_;
+    // слово по номеру: строка из term_storage_ или из файла индекса
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> term_ids_;
+    // число неудалённых документов со словом, по нему считается IDF
+    std::vector<std::uint32_t> document_freqs_;
+    
+    // Постинги хранятся в сегментах по диапазонам порядковых номеров (см.
+    // IndexSegment). Новые документы попадают в активный сегмент; заполненный
+    // сегмент запечатывается и больше не меняется. Удаление документа только
+    // помечает его в documents_, а записи из постингов убирает фоновое слияние
+    // запечатанных сегментов
+    struct SealedSegment {
+        std::shared_ptr<const IndexSegment> segment;
+        // документов, записи которых есть в сегменте, и сколько из них удалено
+        int document_count;
+        int removed_count;
     };
     
-    const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string,  std::map<int, double>, std::less<>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> doc_to_words_freq_;
-    std::map<int, DocumentData> documents_;
+    struct MergeResult {
+        std::shared_ptr<const IndexSegment> segment;
+        // какие документы диапазона были удалены к началу слияния
+        std::vector<bool> is_removed;
+    };
+    
+    // активный сегмент запечатывается при таком числе записей
+    static constexpr size_t SEGMENT_POSTING_LIMIT = 1 << 18;
+    // столько соседних сегментов одного уровня сливаются в один
+    static constexpr size_t MERGE_FACTOR = 4;
+    
+    std::vector<SealedSegment> sealed_segments_;
+    IndexSegment active_segment_{0};
+    // слияние sealed_segments_[merge_first_, merge_first_ + merge_count_),
+    // не больше одного одновременно
+    std::future<MergeResult> merge_;
+    size_t merge_first_ = 0;
+    size_t merge_count_ = 0;
+    
+    std::vector<std::vector<ImpactPosting>> impact_postings_;
+    // документы с номером не меньше границы в impact_postings_ не попали
+    int impact_watermark_ = 0;
+    double impact_accuracy_ = 1.0;
+    // документы нумеруются плотными порядковыми номерами в порядке добавления,
+    // постинги и атрибуты индексируются ими, внешний id нужен только в ответе
+    std::vector<DocumentData> documents_;
+    // прямой индекс; массивы документов, загруженных из файла индекса, лежат
+    // в файле, остальных — в document_term_storage_
+    std::vector<DocumentTermRange> document_terms_;
+    std::vector<std::vector<DocumentTerm>> document_term_storage_;
+    // словари для GetWordFrequencies строятся по прямому индексу при первом
+    // обращении
+    mutable std::vector<std::unique_ptr<const std::map<std::string_view, double>>> word_frequencies_;
+    std::unique_ptr<std::mutex> word_frequencies_mutex_ = std::make_unique<std::mutex>();
+    std::map<int, int> document_ordinals_;
     std::set<int> document_ids_;
+    // меняется при каждом изменении состава индекса и упорядоченных по вкладу
+    // постингов, по ней подготовленные запросы определяют, что сопоставление
+    // слов устарело, а кеш — что устарели выдачи
+    std::uint64_t index_version_ = 0;
+    std::unique_ptr<QueryResultCache> result_cache_;
+    // файл, из которого открыт индекс; на него ссылаются слова словаря,
+    // прямой индекс и постинги загруженного сегмента
+    std::shared_ptr<const MappedFile> mapped_file_;
 
     bool IsStopWord(std::string_view word) const;
     static bool IsValidWord(std::string_view word);
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Заполняет words словами текста без стоп-слов; бросает invalid_argument,
+    // если в тексте есть управляющие символы
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
     
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -92,7 +383,8 @@ private:
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // has_valid_chars — весь запрос уже проверен на управляющие символы
+    QueryWord ParseQueryWord(std::string_view text, bool has_valid_chars) const;
 
     struct Query {
         std::vector<std::string_view> plus_words;
@@ -101,26 +393,213 @@ private:
     };
 
     Query ParseQuery(std::string_view text, bool parallel = false) const;
+    // Плюс- и минус-слова без повторов в порядке возрастания; words — буфер
+    // для слов текста
+    void ParseQuery(std::string_view text, Query& result, 
+        std::vector<std::string_view>& words) const;
+    // Ключ кеша выдач; слова не содержат пробелов и управляющих символов
+    static std::string MakeResultCacheKey(const Query& query, DocumentStatus status, 
+        size_t top_k, QueryEvaluation evaluation);
     
-    double ComputeWordInverseDocumentFreq(const std::string& word) const;
+    // плюс-слово запроса, найденное в индексе
+    struct QueryTerm {
+        // слово словаря, живёт столько же, сколько сервер
+        std::string_view word;
+        TermId term_id;
+        double inverse_document_freq;
+    };
+    
+    // Запрос, сопоставленный словарю: слова, которых нет в индексе, отброшены,
+    // оставшиеся плюс-слова идут в порядке Query::plus_words
+    struct ResolvedQuery {
+        std::vector<QueryTerm> plus_terms;
+        // постинги слова plus_terms[i] в сегменте s лежат по индексу
+        // i * segment_count + s, nullptr — слова в сегменте нет
+        std::vector<const PostingList*> plus_postings;
+        // постинги минус-слов во всех сегментах
+        std::vector<const PostingList*> minus_postings;
+        size_t segment_count;
+        std::uint64_t index_version;
+        
+        const PostingList* GetPostings(size_t term_index, size_t segment) const {
+            return plus_postings[term_index * segment_count + segment];
+        }
+    };
+    
+    struct TermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+    };
+    
+    struct ImpactCursor {
+        const ImpactPosting* current;
+        const ImpactPosting* end;
+        double inverse_document_freq;
+    };
+    
+    int GetOrdinal(int document_id) const;
     
+    // Слово документа или nullptr, если его в документе нет
+    const DocumentTerm* FindDocumentTerm(int ordinal, TermId term_id) const;
+    void ClearDocumentTerms(int ordinal);
+    void RemoveDocuments(const std::vector<int>& document_ids, bool parallel);
+    
+    TermId GetOrAddTermId(std::string_view word);
+    
+    double ComputeWordInverseDocumentFreq(TermId term_id) const;
+    // Число документов, содержащих слово
+    size_t GetDocumentFrequency(std::string_view word) const;
+    
+    void ResolveQuery(const Query& query, ResolvedQuery& result) const;
+    
+    // Вызывает func для каждого сегмента по возрастанию номеров документов
+    template <typename Func>
+    void ForEachSegment(Func func) const;
+    
+    void SealActiveSegment();
+    // Учитывает удаление документов (номера по возрастанию) в счётчиках
+    // их запечатанных сегментов
+    void MarkRemovedInSegments(const std::vector<int>& ordinals);
+    // Запускает фоновое слияние, если оно не идёт и есть что сливать
+    void ScheduleMerge();
+    // Подключает результат фонового слияния, если оно завершилось
+    void PollMerge();
+    void InstallMerge();
+    std::shared_ptr<const ResolvedQuery> GetResolvedQuery(const PreparedQuery& prepared_query) const;
+    
+    // Выполняет разобранный запрос последовательно, но с IDF плюс-слов,
+    // вычисленными снаружи (по порядку Query::plus_words), например по общей
+    // статистике нескольких серверов
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy,
-        const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocumentsWithInverseDocumentFreqs(const Query& query, 
+        const std::vector<double>& inverse_document_freqs, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    // Все вычисления записывают выдачу в context.result_
+    template <typename Policy, typename DocumentPredicate>
+    void ExecuteQuery(Policy&& policy, QueryContext& context, const ResolvedQuery& query, 
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+    
+    void ExcludeMinusWords(const ResolvedQuery& query, ScoreAccumulator& accumulator) const;
     
+    // Релевантность документа, просуммированная в порядке слов запроса, как при
+    // полном обходе, чтобы результаты досрочных вычислений совпадали до бита
+    double ComputeExactRelevance(const ResolvedQuery& query, int ordinal) const;
+    
+    // Подсчитывает релевантность всех подходящих документов и отбирает top_k лучших
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, 
-        DocumentPredicate document_predicate) const;
+    void FindAllDocuments(std::execution::sequenced_policy, QueryContext& context,
+        const ResolvedQuery& query, DocumentPredicate document_predicate, size_t top_k) const;
     
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy,
-        const Query& query, DocumentPredicate document_predicate) const;
+    void FindAllDocuments(QueryContext& context, const ResolvedQuery& query, 
+        DocumentPredicate document_predicate, size_t top_k) const;
+    
+    template <typename DocumentPredicate>
+    void FindAllDocuments(std::execution::parallel_policy, QueryContext& context,
+        const ResolvedQuery& query, DocumentPredicate document_predicate, size_t top_k) const;
+    
+    template <typename DocumentPredicate>
+    void FindDocumentsWithPruning(QueryContext& context, const ResolvedQuery& query, 
+        DocumentPredicate document_predicate, size_t top_k) const;
+    
+    template <typename DocumentPredicate>
+    void FindDocumentsByImpact(QueryContext& context, const ResolvedQuery& query, 
+        DocumentPredicate document_predicate, size_t top_k) const;
+    
+    // Отбирает лучшие по накопленной релевантности документы и пересчитывает
+    // их релевантность точно; кандидаты в пределах допуска сравнения тоже
+    // пересчитываются, чтобы почти равные упорядочились как при полном обходе
+    void SelectExactTopDocuments(QueryContext& context, const ResolvedQuery& query, 
+        size_t top_k) const;
+};
+
+// Запрос, подготовленный SearchServer::PrepareQuery. Выполняется только тем
+// сервером, который его подготовил
+class SearchServer::PreparedQuery {
+private:
+    friend class SearchServer;
+    
+    PreparedQuery(const SearchServer& search_server, std::string_view raw_query,
+        std::shared_ptr<const ResolvedQuery> resolved_query);
+    
+    const SearchServer* search_server_;
+    // текст запроса нужен для повторного сопоставления после изменения индекса
+    std::string raw_query_;
+    // читается и заменяется атомарно, поэтому запрос можно выполнять
+    // одновременно из нескольких потоков
+    mutable std::shared_ptr<const ResolvedQuery> resolved_query_;
+};
+
+// Загрузка большого корпуса: тексты копируются и добавляются в сервер через
+// AddDocuments пакетами по batch_size документов. Ошибки в документах
+// обнаруживаются при добавлении пакета. Документы, оставшиеся в накопителе
+// при разрушении, не добавляются, поэтому загрузку завершает Flush
+class SearchServer::IndexBuilder {
+public:
+    static constexpr size_t DEFAULT_BATCH_SIZE = 1 << 16;
+    
+    explicit IndexBuilder(SearchServer& search_server, size_t batch_size = DEFAULT_BATCH_SIZE);
+    
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, 
+        const std::vector<int>& ratings);
+    // Добавляет накопленные документы в сервер
+    void Flush();
+    
+private:
+    SearchServer* search_server_;
+    size_t batch_size_;
+    // deque не перемещает строки, на которые ссылаются documents_
+    std::deque<std::string> texts_;
+    std::vector<NewDocument> documents_;
+};
+
+// Буферы для выполнения запросов, переиспользуемые от запроса к запросу.
+// Контекст нельзя использовать из нескольких потоков одновременно
+class SearchServer::QueryContext {
+public:
+    QueryContext() = default;
+    
+private:
+    friend class SearchServer;
+    
+    // Контекст из пула текущего потока на время запроса. Пул, а не один
+    // контекст на поток, нужен потому, что параллельный алгоритм может
+    // выполнить на ожидающем потоке вложенный запрос
+    class ThreadLease {
+    public:
+        ThreadLease();
+        ~ThreadLease();
+        
+        ThreadLease(const ThreadLease&) = delete;
+        ThreadLease& operator=(const ThreadLease&) = delete;
+        
+        QueryContext& Get() const;
+        
+    private:
+        QueryContext* context_;
+    };
+    
+    std::vector<std::string_view> words_;
+    Query query_;
+    ResolvedQuery resolved_query_;
+    ScoreAccumulator accumulator_;
+    std::vector<TermCursor> term_cursors_;
+    std::vector<double> upper_bound_prefix_;
+    std::vector<double> window_relevance_;
+    std::vector<bool> window_touched_;
+    std::vector<ImpactCursor> impact_cursors_;
+    std::vector<double> scores_;
+    TopDocuments top_documents_{0};
+    std::vector<Document> result_;
 };
 
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
     : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
-    if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
+    const std::vector<std::string_view> words = stop_words_.GetWords();
+    if (!all_of(words.begin(), words.end(), IsValidWord)) {
         throw std::invalid_argument("Some of stop words are invalid");
     }
 }
@@ -128,28 +607,69 @@ SearchServer::SearchServer(const StringContainer& stop_words)
 template <typename Policy, typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, 
     std::string_view raw_query, 
-    DocumentPredicate document_predicate) const {
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
     
-    const auto query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    const QueryContext::ThreadLease lease;
+    QueryContext& context = lease.Get();
+    ParseQuery(raw_query, context.query_, context.words_);
+    ResolveQuery(context.query_, context.resolved_query_);
+    ExecuteQuery(policy, context, context.resolved_query_, document_predicate, top_k, evaluation);
+    return context.result_;
+}
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(), 
-        [](const Document& lhs, const Document& rhs) {
-            double epsilon =  1e-6;
+template <typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    // последовательные запросы идут через кеш выдач
+    if constexpr (std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>) {
+        return FindTopDocuments(raw_query, status, top_k, evaluation);
+    } else {
+        return FindTopDocuments(policy, raw_query, 
+            [status](int, DocumentStatus document_status, int) {
+                return document_status == status;
+            }, 
+            top_k, evaluation
+        );
+    }
+}
 
-            if (std::abs(lhs.relevance - rhs.relevance) < epsilon) {
-                return lhs.rating > rhs.rating;
-            } else {
-                return lhs.relevance > rhs.relevance;
-            }
-        }
-    );
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k, evaluation);
+}
 
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-     }
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, 
+    std::string_view raw_query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
+    
+    return FindTopDocuments(policy, raw_query, document_predicate, top_k, 
+        QueryEvaluation::EXHAUSTIVE);
+}
 
-    return matched_documents;
+template <typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, std::string_view raw_query, 
+    DocumentStatus status, size_t top_k) const {
+    
+    return FindTopDocuments(policy, raw_query, status, top_k, QueryEvaluation::EXHAUSTIVE);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
+    
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k);
+}
+
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, 
+    std::string_view raw_query, 
+    DocumentPredicate document_predicate) const {
+    
+    return FindTopDocuments(policy, raw_query, document_predicate, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 template <typename DocumentPredicate>
@@ -163,11 +683,7 @@ template <typename Policy>
 std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, std::string_view raw_query, 
     DocumentStatus status) const {
     
-    return FindTopDocuments(policy, raw_query, 
-        [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        }
-    );
+    return FindTopDocuments(policy, raw_query, status, MAX_RESULT_DOCUMENT_COUNT);
 }
 
 template <typename Policy>
@@ -177,127 +693,539 @@ std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy,
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, 
+    const PreparedQuery& prepared_query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+    
+    const auto query = GetResolvedQuery(prepared_query);
+    const QueryContext::ThreadLease lease;
+    ExecuteQuery(policy, lease.Get(), *query, document_predicate, top_k, evaluation);
+    return lease.Get().result_;
+}
+
+template <typename Policy>
+std::vector<Document> SearchServer::FindTopDocuments(Policy&& policy, 
+    const PreparedQuery& prepared_query, 
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(policy, prepared_query, 
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        }, 
+        top_k, evaluation
+    );
+}
+
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, 
-    const Query& query, 
-    DocumentPredicate document_predicate) const {
+std::vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& prepared_query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+    
+    return FindTopDocuments(std::execution::seq, prepared_query, document_predicate, 
+        top_k, evaluation);
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    std::string_view raw_query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
     
-    std::map<int, double> document_to_relevance;
+    ParseQuery(raw_query, context.query_, context.words_);
+    ResolveQuery(context.query_, context.resolved_query_);
+    ExecuteQuery(std::execution::seq, context, context.resolved_query_, document_predicate, 
+        top_k, evaluation);
+    return context.result_;
+}
+
+template <typename DocumentPredicate>
+const std::vector<Document>& SearchServer::FindTopDocuments(QueryContext& context, 
+    const PreparedQuery& prepared_query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
     
-    for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
+    const auto query = GetResolvedQuery(prepared_query);
+    ExecuteQuery(std::execution::seq, context, *query, document_predicate, top_k, evaluation);
+    return context.result_;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsWithInverseDocumentFreqs(const Query& query, 
+    const std::vector<double>& inverse_document_freqs, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+    
+    const QueryContext::ThreadLease lease;
+    QueryContext& context = lease.Get();
+    ResolveQuery(query, context.resolved_query_);
+    
+    // найденные в индексе слова идут в том же порядке, что и все плюс-слова
+    auto& plus_terms = context.resolved_query_.plus_terms;
+    size_t word_index = 0;
+    for (QueryTerm& term : plus_terms) {
+        while (query.plus_words[word_index] != term.word) {
+            ++word_index;
         }
+        term.inverse_document_freq = inverse_document_freqs[word_index];
     }
+    
+    ExecuteQuery(std::execution::seq, context, context.resolved_query_, document_predicate, 
+        top_k, evaluation);
+    return context.result_;
+}
 
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-            document_to_relevance.erase(document_id);
+template <typename Func>
+void SearchServer::ForEachSegment(Func func) const {
+    for (const SealedSegment& sealed_segment : sealed_segments_) {
+        func(*sealed_segment.segment);
+    }
+    func(active_segment_);
+}
+
+template <typename Policy, typename DocumentPredicate>
+void SearchServer::ExecuteQuery(Policy&& policy, QueryContext& context, const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+    
+    if (evaluation == QueryEvaluation::DYNAMIC_PRUNING) {
+        FindDocumentsWithPruning(context, query, document_predicate, top_k);
+    } else if (evaluation == QueryEvaluation::IMPACT_ORDERED) {
+        FindDocumentsByImpact(context, query, document_predicate, top_k);
+    } else {
+        FindAllDocuments(policy, context, query, document_predicate, top_k);
+    }
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindAllDocuments(std::execution::sequenced_policy, QueryContext& context, 
+    const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
+    
+    ScoreAccumulator& accumulator = context.accumulator_;
+    accumulator.Reset(documents_.size());
+    ExcludeMinusWords(query, accumulator);
+    
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const double inverse_document_freq = query.plus_terms[i].inverse_document_freq;
+        for (size_t segment = 0; segment < query.segment_count; ++segment) {
+            const PostingList* postings = query.GetPostings(i, segment);
+            if (postings == nullptr) {
+                continue;
+            }
+            postings->ForEach([&](int ordinal, std::uint32_t count) {
+                if (accumulator.IsExcluded(ordinal)) {
+                    return;
+                }
+                const auto& document_data = documents_[ordinal];
+                if (!document_data.is_removed 
+                    && document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    accumulator.Add(ordinal, count * document_data.inv_word_count * inverse_document_freq);
+                }
+            });
         }
     }
 
-    std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+    TopDocuments& top_documents = context.top_documents_;
+    top_documents.Reset(top_k);
+    for (const int ordinal : accumulator.GetTouched()) {
+        const auto& document_data = documents_[ordinal];
+        top_documents.Push({document_data.id, accumulator.GetScore(ordinal), document_data.rating});
     }
-    return matched_documents;
+    top_documents.ExtractTo(context.result_);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query, 
-    DocumentPredicate document_predicate) const {
+void SearchServer::FindAllDocuments(QueryContext& context, const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
     
-    return FindAllDocuments(std::execution::seq, query, document_predicate);
+    FindAllDocuments(std::execution::seq, context, query, document_predicate, top_k);
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, 
-    const Query& query, 
-    DocumentPredicate document_predicate) const {
+void SearchServer::FindAllDocuments(std::execution::parallel_policy, QueryContext& context, 
+    const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
     
-    ConcurrentMap<int, double> document_to_relevance(100);
+    // на коротких постингах запуск задач обходится дороже самого подсчёта
+    constexpr size_t MIN_PARALLEL_POSTING_COUNT = 16384;
+    size_t posting_count = 0;
+    for (const PostingList* postings : query.plus_postings) {
+        if (postings != nullptr) {
+            posting_count += postings->Size();
+        }
+    }
+    if (posting_count < MIN_PARALLEL_POSTING_COUNT) {
+        FindAllDocuments(std::execution::seq, context, query, document_predicate, top_k);
+        return;
+    }
     
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(),
-        [this, &document_to_relevance, document_predicate] (std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
-            }
+    const ScoreAccumulator& excluded = context.accumulator_;
+    context.accumulator_.Reset(documents_.size());
+    ExcludeMinusWords(query, context.accumulator_);
+    
+    // Порядковые номера документов делятся на непересекающиеся диапазоны.
+    // Каждая часть проходит свой диапазон во всех постингах запроса, копит
+    // релевантность в собственном накопителе и отбирает свои top_k, поэтому
+    // общих изменяемых данных у частей нет. Частей больше, чем потоков, чтобы
+    // диапазоны с длинными постингами не задерживали остальные
+    constexpr size_t PARTS_PER_THREAD = 4;
+    const size_t document_count = documents_.size();
+    const size_t part_count = std::min(document_count, 
+        std::max(1u, std::thread::hardware_concurrency()) * PARTS_PER_THREAD);
+    std::vector<TopDocuments> part_tops(part_count, TopDocuments(top_k));
+    std::vector<size_t> part_indexes(part_count);
+    std::iota(part_indexes.begin(), part_indexes.end(), 0);
+    
+    std::for_each(std::execution::par, part_indexes.begin(), part_indexes.end(),
+        [&] (size_t part) {
+            const int first = static_cast<int>(document_count * part / part_count);
+            const int last = static_cast<int>(document_count * (part + 1) / part_count);
             
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
+            const QueryContext::ThreadLease lease;
+            ScoreAccumulator& accumulator = lease.Get().accumulator_;
+            accumulator.Reset(document_count);
             
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+            // слова обходятся в порядке запроса, как при последовательном
+            // подсчёте, поэтому суммы совпадают до бита
+            for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+                const double inverse_document_freq = query.plus_terms[i].inverse_document_freq;
+                for (size_t segment = 0; segment < query.segment_count; ++segment) {
+                    const PostingList* postings = query.GetPostings(i, segment);
+                    if (postings == nullptr) {
+                        continue;
+                    }
+                    PostingList::Cursor cursor(*postings);
+                    for (cursor.SkipTo(first); cursor.GetDocumentId() < last; cursor.Next()) {
+                        const int ordinal = cursor.GetDocumentId();
+                        if (excluded.IsExcluded(ordinal)) {
+                            continue;
+                        }
+                        const auto& document_data = documents_[ordinal];
+                        if (!document_data.is_removed 
+                            && document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                            accumulator.Add(ordinal, 
+                                cursor.GetCount() * document_data.inv_word_count * inverse_document_freq);
+                        }
+                    }
                 }
             }
+            
+            for (const int ordinal : accumulator.GetTouched()) {
+                const auto& document_data = documents_[ordinal];
+                part_tops[part].Push({document_data.id, accumulator.GetScore(ordinal), 
+                    document_data.rating});
+            }
         }
     );
     
-    std::map<int, double> doc_to_rel_ordinary = document_to_relevance.BuildOrdinaryMap();
-             
-    std::for_each(std::execution::seq, query.minus_words.begin(),
-        query.minus_words.end(), 
-        [this, &doc_to_rel_ordinary] (std::string_view word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
+    for (size_t part = 1; part < part_count; ++part) {
+        part_tops[0].Merge(part_tops[part]);
+    }
+    
+    part_tops[0].ExtractTo(context.result_);
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindDocumentsWithPruning(QueryContext& context, const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
+    
+    ScoreAccumulator& accumulator = context.accumulator_;
+    accumulator.Reset(documents_.size());
+    ExcludeMinusWords(query, accumulator);
+    
+    // документ войдёт в выдачу, только если его релевантность больше порога;
+    // допуск 1e-6 повторяет сравнение в IsMoreRelevant, где почти равные
+    // релевантности сравниваются по рейтингу
+    const double epsilon = 1e-6;
+    double threshold = -std::numeric_limits<double>::infinity();
+    TopDocuments& top_documents = context.top_documents_;
+    top_documents.Reset(top_k);
+    
+    // MaxScore: слова [0, first_essential) вместе не могут поднять документ
+    // выше порога, поэтому кандидаты берутся только из постингов остальных
+    // ("основных") слов, а в постингах неосновных ищется только сам кандидат.
+    // Основные слова обходятся окнами по WINDOW_SIZE документов: их вклады
+    // накапливаются в массиве окна, после чего кандидаты окна проверяются
+    // по возрастанию номера
+    constexpr int WINDOW_SIZE = 4096;
+    std::vector<double>& window_relevance = context.window_relevance_;
+    std::vector<bool>& window_touched = context.window_touched_;
+    window_relevance.resize(WINDOW_SIZE);
+    window_touched.assign(WINDOW_SIZE, false);
+    std::vector<TermCursor>& term_cursors = context.term_cursors_;
+    std::vector<double>& upper_bound_prefix = context.upper_bound_prefix_;
+    
+    // Сегменты обходятся по очереди с общими выдачей и порогом: порог,
+    // набранный в прежних сегментах, сразу отсекает слова в следующих
+    for (size_t segment = 0; top_k > 0 && segment < query.segment_count; ++segment) {
+        term_cursors.clear();
+        for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+            const PostingList* postings = query.GetPostings(i, segment);
+            if (postings == nullptr) {
+                continue;
+            }
+            const double inverse_document_freq = query.plus_terms[i].inverse_document_freq;
+            term_cursors.push_back({PostingList::Cursor(*postings), inverse_document_freq,
+                postings->GetMaxTermFreq() * inverse_document_freq});
+        }
+        
+        // слова упорядочены по возрастанию верхней оценки вклада;
+        // upper_bound_prefix[i] — сумма оценок слов с 0 по i
+        std::sort(term_cursors.begin(), term_cursors.end(), 
+            [](const TermCursor& lhs, const TermCursor& rhs) {
+                return lhs.upper_bound < rhs.upper_bound;
             }
+        );
+        upper_bound_prefix.resize(term_cursors.size());
+        double upper_bound_sum = 0.0;
+        for (size_t i = 0; i < term_cursors.size(); ++i) {
+            upper_bound_sum += term_cursors[i].upper_bound;
+            upper_bound_prefix[i] = upper_bound_sum;
+        }
+        
+        size_t first_essential = 0;
+        while (top_documents.IsFull() && first_essential < term_cursors.size() 
+            && upper_bound_prefix[first_essential] <= threshold) {
+            ++first_essential;
+        }
+        
+        while (first_essential < term_cursors.size()) {
+            int window_begin = PostingList::Cursor::END;
+            for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+                window_begin = std::min(window_begin, term_cursors[i].cursor.GetDocumentId());
+            }
+            if (window_begin == PostingList::Cursor::END) {
+                break;
+            }
+            const int window_end = window_begin + std::min(WINDOW_SIZE, PostingList::Cursor::END - window_begin);
             
-            for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-                doc_to_rel_ordinary.erase(document_id);
+            for (size_t i = first_essential; i < term_cursors.size(); ++i) {
+                PostingList::Cursor& cursor = term_cursors[i].cursor;
+                for (; cursor.GetDocumentId() < window_end; cursor.Next()) {
+                    const int ordinal = cursor.GetDocumentId();
+                    const double contribution = cursor.GetCount() 
+                        * documents_[ordinal].inv_word_count * term_cursors[i].inverse_document_freq;
+                    const int position = ordinal - window_begin;
+                    if (window_touched[position]) {
+                        window_relevance[position] += contribution;
+                    } else {
+                        window_touched[position] = true;
+                        window_relevance[position] = contribution;
+                    }
+                }
+            }
+            
+            const size_t window_first_essential = first_essential;
+            
+            for (int position = 0; position < window_end - window_begin; ++position) {
+                if (!window_touched[position]) {
+                    continue;
+                }
+                window_touched[position] = false;
+                
+                const int ordinal = window_begin + position;
+                const auto& document_data = documents_[ordinal];
+                if (document_data.is_removed || accumulator.IsExcluded(ordinal) 
+                    || !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+                    continue;
+                }
+                
+                // сначала грубая оценка по словам целиком, затем более точная по блокам,
+                // в которые попал бы документ, и только потом поиск в постингах
+                double relevance = window_relevance[position];
+                if (window_first_essential > 0 
+                    && relevance + upper_bound_prefix[window_first_essential - 1] <= threshold) {
+                    continue;
+                }
+                double block_upper_bound = relevance;
+                for (size_t i = 0; i < window_first_essential; ++i) {
+                    block_upper_bound += term_cursors[i].cursor.GetBlockMaxTermFreq(ordinal) 
+                        * term_cursors[i].inverse_document_freq;
+                }
+                if (block_upper_bound <= threshold) {
+                    continue;
+                }
+                
+                bool pruned = false;
+                for (size_t i = window_first_essential; i-- > 0;) {
+                    if (relevance + upper_bound_prefix[i] <= threshold) {
+                        pruned = true;
+                        break;
+                    }
+                    PostingList::Cursor& cursor = term_cursors[i].cursor;
+                    cursor.SkipTo(ordinal);
+                    if (cursor.GetDocumentId() == ordinal) {
+                        relevance += cursor.GetCount() 
+                            * document_data.inv_word_count * term_cursors[i].inverse_document_freq;
+                    }
+                }
+                if (pruned || relevance <= threshold) {
+                    continue;
+                }
+                
+                top_documents.Push({document_data.id, ComputeExactRelevance(query, ordinal), 
+                    document_data.rating});
+                
+                if (top_documents.IsFull()) {
+                    threshold = top_documents.GetWorst().relevance - epsilon;
+                }
+            }
+            
+            while (top_documents.IsFull() && first_essential < term_cursors.size() 
+                && upper_bound_prefix[first_essential] <= threshold) {
+                ++first_essential;
             }
         }
-    );
+    }
+    
+    top_documents.ExtractTo(context.result_);
+}
+
+template <typename DocumentPredicate>
+void SearchServer::FindDocumentsByImpact(QueryContext& context, const ResolvedQuery& query, 
+    DocumentPredicate document_predicate, size_t top_k) const {
     
-    std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : doc_to_rel_ordinary) {
-        matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+    if (top_k == 0) {
+        context.result_.clear();
+        return;
     }
     
-    return matched_documents;
+    ScoreAccumulator& accumulator = context.accumulator_;
+    accumulator.Reset(documents_.size());
+    ExcludeMinusWords(query, accumulator);
+    
+    const auto add_contribution = [&](int ordinal, std::uint32_t count, double inverse_document_freq) {
+        const auto& document_data = documents_[ordinal];
+        if (document_data.is_removed || accumulator.IsExcluded(ordinal) 
+            || !document_predicate(document_data.id, document_data.status, document_data.rating)) {
+            return;
+        }
+        accumulator.Add(ordinal, count * document_data.inv_word_count * inverse_document_freq);
+    };
+    
+    std::vector<ImpactCursor>& cursors = context.impact_cursors_;
+    cursors.clear();
+    
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const TermId term_id = query.plus_terms[i].term_id;
+        const double inverse_document_freq = query.plus_terms[i].inverse_document_freq;
+        
+        // документы, добавленные после RefreshImpactOrder, учитываются сразу целиком
+        for (size_t segment = 0; segment < query.segment_count; ++segment) {
+            const PostingList* postings = query.GetPostings(i, segment);
+            if (postings == nullptr) {
+                continue;
+            }
+            PostingList::Cursor cursor(*postings);
+            for (cursor.SkipTo(impact_watermark_); !cursor.IsEnd(); cursor.Next()) {
+                add_contribution(cursor.GetDocumentId(), cursor.GetCount(), inverse_document_freq);
+            }
+        }
+        
+        if (term_id < impact_postings_.size() && !impact_postings_[term_id].empty()) {
+            const auto& impacts = impact_postings_[term_id];
+            cursors.push_back({impacts.data(), impacts.data() + impacts.size(), inverse_document_freq});
+        }
+    }
+    
+    const auto head_impact = [this](const ImpactCursor& cursor) {
+        if (cursor.current == cursor.end) {
+            return 0.0;
+        }
+        return cursor.current->count * documents_[cursor.current->ordinal].inv_word_count 
+            * cursor.inverse_document_freq;
+    };
+    
+    // Проверка досрочной остановки: если лучший документ вне текущего top_k
+    // (или ещё не встреченный, у него ноль) даже с остатком вкладов не догонит
+    // k-й, состав выдачи уже не изменится. Допуск 1e-6 — как в IsMoreRelevant
+    const double epsilon = 1e-6;
+    std::vector<double>& scores = context.scores_;
+    const auto can_stop = [&](double remaining_bound) {
+        const auto& touched = accumulator.GetTouched();
+        if (touched.size() < top_k) {
+            return false;
+        }
+        scores.clear();
+        for (const int ordinal : touched) {
+            scores.push_back(accumulator.GetScore(ordinal));
+        }
+        std::nth_element(scores.begin(), scores.begin() + (top_k - 1), scores.end(), 
+            std::greater<double>());
+        const double kth_score = scores[top_k - 1];
+        double outside_score = 0.0;
+        for (size_t i = top_k; i < scores.size(); ++i) {
+            outside_score = std::max(outside_score, scores[i]);
+        }
+        return outside_score + impact_accuracy_ * remaining_bound <= kth_score - epsilon;
+    };
+    
+    // вклады обрабатываются порциями из списка с наибольшим текущим вкладом;
+    // проверка линейна по числу встреченных документов, поэтому интервал между
+    // проверками растёт вместе с объёмом обработанного
+    constexpr size_t BATCH_SIZE = 64;
+    constexpr size_t CHECK_INTERVAL = 4096;
+    size_t processed = 0;
+    size_t next_check = CHECK_INTERVAL;
+    
+    while (true) {
+        ImpactCursor* best = nullptr;
+        double best_impact = 0.0;
+        double remaining_bound = 0.0;
+        for (ImpactCursor& cursor : cursors) {
+            const double impact = head_impact(cursor);
+            remaining_bound += impact;
+            if (cursor.current != cursor.end && (best == nullptr || impact > best_impact)) {
+                best = &cursor;
+                best_impact = impact;
+            }
+        }
+        if (best == nullptr) {
+            break;
+        }
+        if (processed >= next_check) {
+            next_check = processed + std::max(CHECK_INTERVAL, processed / 2);
+            if (can_stop(remaining_bound)) {
+                break;
+            }
+        }
+        
+        for (size_t i = 0; i < BATCH_SIZE && best->current != best->end; ++i, ++best->current) {
+            add_contribution(best->current->ordinal, best->current->count, best->inverse_document_freq);
+        }
+        processed += BATCH_SIZE;
+    }
+    
+    SelectExactTopDocuments(context, query, top_k);
 }
 
 template <class Policy>
 SearchServer::MatchResult SearchServer::MatchDocument(Policy&& policy,
     std::string_view raw_query, int document_id) const {
     
-    if (documents_.count(document_id) == 0) {
-        throw std::out_of_range("no such id");
-    }
+    const int ordinal = GetOrdinal(document_id);
 
     Query query = ParseQuery(raw_query, 
         std::is_same_v<Policy, std::execution::parallel_policy>);
+    
+    // слово словаря, если оно есть в документе, иначе пустая строка
+    const auto find_word = [this, ordinal] (const std::string_view& word) {
+        const auto it = term_ids_.find(word);
+        if (it != term_ids_.end() && FindDocumentTerm(ordinal, it->second) != nullptr) {
+            return it->first;
+        }
+        
+        return std::string_view{};
+    };
 
     if (any_of(policy, query.minus_words.begin(), query.minus_words.end(),
-            [this, document_id] (const std::string_view& word) {
-                return doc_to_words_freq_.at(document_id).count(word);
+            [&find_word] (const std::string_view& word) {
+                return !find_word(word).empty();
             })) {
         
-        return {std::vector<std::string_view>{}, documents_.at(document_id).status};
+        return {std::vector<std::string_view>{}, documents_[ordinal].status};
     }
     
     std::vector<std::string_view> matched_words(query.plus_words.size());
 
     transform(policy, query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(),
-        [this, document_id] (const std::string_view& word) {
-            if (doc_to_words_freq_.at(document_id).count(word)) {
-                return std::string_view{word_to_document_freqs_.find(word)->first};
-            }
-            
-            return std::string_view{};
-        }
-    );
+        matched_words.begin(), find_word);
     
     matched_words.erase(std::remove(matched_words.begin(), 
         matched_words.end(), std::string_view{}), matched_words.end());
@@ -308,5 +1236,5 @@ SearchServer::MatchResult SearchServer::MatchDocument(Policy&& policy,
         matched_words.erase(it, matched_words.end());
     }
     
-    return {matched_words, documents_.at(document_id).status};
+    return {matched_words, documents_[ordinal].status};
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "sharded_search_server.h"
+
+using namespace std;
+
+ShardedSearchServer::ShardedSearchServer(string_view stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count)
+    : ShardedSearchServer(SplitIntoWords(stop_words_text), shard_count) {
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document,
+    DocumentStatus status, const vector<int>& ratings) {
+
+    Shard& shard = GetShard(document_id);
+    const lock_guard guard(shard.mutex);
+    shard.search_server.AddDocument(document_id, document, status, ratings);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query,
+    DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const {
+
+    return FindTopDocuments(raw_query,
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        },
+        top_k, evaluation
+    );
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query,
+    DocumentStatus status) const {
+
+    return FindTopDocuments(raw_query, status, MAX_RESULT_DOCUMENT_COUNT,
+        QueryEvaluation::EXHAUSTIVE);
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    int document_count = 0;
+    for (const Shard& shard : shards_) {
+        const shared_lock lock(shard.mutex);
+        document_count += shard.search_server.GetDocumentCount();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+SearchServer::MatchResult ShardedSearchServer::MatchDocument(string_view raw_query,
+    int document_id) const {
+
+    const Shard& shard = GetShard(document_id);
+    const shared_lock lock(shard.mutex);
+    return shard.search_server.MatchDocument(raw_query, document_id);
+}
+
+map<string_view, double> ShardedSearchServer::GetWordFrequencies(int document_id) const {
+    const Shard& shard = GetShard(document_id);
+    const shared_lock lock(shard.mutex);
+    return shard.search_server.GetWordFrequencies(document_id);
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    Shard& shard = GetShard(document_id);
+    const lock_guard guard(shard.mutex);
+    shard.search_server.RemoveDocument(document_id);
+}
+
+const ShardedSearchServer::Shard& ShardedSearchServer::GetShard(int document_id) const {
+    // мультипликативный хеш, чтобы id с общим шагом не попадали в один шард
+    const uint64_t hash = static_cast<uint64_t>(static_cast<uint32_t>(document_id))
+        * 0x9E3779B97F4A7C15ull;
+    return shards_[(hash >> 32) % shards_.size()];
+}
+
+ShardedSearchServer::Shard& ShardedSearchServer::GetShard(int document_id) {
+    return const_cast<Shard&>(static_cast<const ShardedSearchServer&>(*this).GetShard(document_id));
+}
+
+vector<double> ShardedSearchServer::ComputeInverseDocumentFreqs(
+    const SearchServer::Query& query) const {
+
+    int document_count = 0;
+    for (const Shard& shard : shards_) {
+        document_count += shard.search_server.GetDocumentCount();
+    }
+
+    // то же выражение, что в SearchServer::ComputeWordInverseDocumentFreq,
+    // чтобы IDF совпадал с одним общим сервером до бита
+    vector<double> inverse_document_freqs(query.plus_words.size(), 0.0);
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        size_t document_freq = 0;
+        for (const Shard& shard : shards_) {
+            document_freq += shard.search_server.GetDocumentFrequency(query.plus_words[i]);
+        }
+        if (document_freq > 0) {
+            inverse_document_freqs[i] = log(document_count * 1.0 / document_freq);
+        }
+    }
+    return inverse_document_freqs;
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "search_server.h"
+#include "top_documents.h"
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <execution>
+#include <mutex>
+#include <numeric>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// Поисковый сервер, документы которого распределены по хешу id между
+// независимыми SearchServer (шардами). Запрос выполняется на всех шардах, их
+// top_k сливаются. IDF считается по общей статистике всех шардов, поэтому
+// релевантности и выдача совпадают с одним сервером, содержащим все документы.
+// Методы можно вызывать из разных потоков: изменения блокируют только свой
+// шард, поэтому добавление в разные шарды идёт параллельно, а запрос
+// блокирует шарды на чтение на время выполнения.
+class ShardedSearchServer {
+public:
+    template <typename StringContainer>
+    ShardedSearchServer(const StringContainer& stop_words, size_t shard_count);
+    ShardedSearchServer(std::string_view stop_words_text, size_t shard_count);
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    // Шарды опрашиваются согласно policy; перегрузки без policy опрашивают их параллельно
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(Policy&& policy, std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        DocumentPredicate document_predicate) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        DocumentStatus status, size_t top_k, QueryEvaluation evaluation) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query,
+        DocumentStatus status) const;
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+    int GetDocumentCount() const;
+    size_t GetShardCount() const;
+
+    SearchServer::MatchResult MatchDocument(std::string_view raw_query, int document_id) const;
+
+    // Возвращает копию, снятую под блокировкой шарда: ссылка на словарь шарда
+    // стала бы недействительной при параллельном RemoveDocument
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    void RemoveDocument(int document_id);
+
+private:
+    struct Shard {
+        template <typename StopWords>
+        explicit Shard(const StopWords& stop_words)
+            : search_server(stop_words) {
+        }
+
+        SearchServer search_server;
+        mutable std::shared_mutex mutex;
+    };
+
+    // deque, потому что шард с мьютексом нельзя перемещать
+    std::deque<Shard> shards_;
+
+    const Shard& GetShard(int document_id) const;
+    Shard& GetShard(int document_id);
+
+    // IDF плюс-слов запроса по статистике всех шардов; шарды должны быть
+    // заблокированы вызывающим
+    std::vector<double> ComputeInverseDocumentFreqs(const SearchServer::Query& query) const;
+};
+
+template <typename StringContainer>
+ShardedSearchServer::ShardedSearchServer(const StringContainer& stop_words, size_t shard_count) {
+    if (shard_count == 0) {
+        throw std::invalid_argument("Shard count must be positive");
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.emplace_back(stop_words);
+    }
+}
+
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(Policy&& policy,
+    std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+
+    // стоп-слова у всех шардов одинаковые, так что разобрать запрос может любой
+    const SearchServer::Query query = shards_.front().search_server.ParseQuery(raw_query);
+
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    locks.reserve(shards_.size());
+    for (const Shard& shard : shards_) {
+        locks.emplace_back(shard.mutex);
+    }
+
+    const std::vector<double> inverse_document_freqs = ComputeInverseDocumentFreqs(query);
+
+    std::vector<std::vector<Document>> shard_documents(shards_.size());
+    std::vector<size_t> shard_indexes(shards_.size());
+    std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+
+    std::for_each(policy, shard_indexes.begin(), shard_indexes.end(),
+        [&] (size_t i) {
+            shard_documents[i] = shards_[i].search_server.FindTopDocumentsWithInverseDocumentFreqs(
+                query, inverse_document_freqs, document_predicate, top_k, evaluation);
+        }
+    );
+
+    TopDocuments top_documents(top_k);
+    for (const auto& documents : shard_documents) {
+        for (const Document& document : documents) {
+            top_documents.Push(document);
+        }
+    }
+    return top_documents.Extract();
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t top_k, QueryEvaluation evaluation) const {
+
+    return FindTopDocuments(std::execution::par, raw_query, document_predicate, top_k, evaluation);
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> ShardedSearchServer::FindTopDocuments(std::string_view raw_query,
+    DocumentPredicate document_predicate) const {
+
+    return FindTopDocuments(raw_query, document_predicate, MAX_RESULT_DOCUMENT_COUNT,
+        QueryEvaluation::EXHAUSTIVE);
+}
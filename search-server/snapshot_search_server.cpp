@@ -0,0 +1,162 @@
+#include "snapshot_search_server.h"
+
+#include <exception>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+void SnapshotSearchServer::WriteBatch::AddDocument(int document_id, string_view document,
+    DocumentStatus status, const vector<int>& ratings) {
+
+    operations_.push_back({OperationType::ADD, document_id, string(document), status, ratings});
+}
+
+void SnapshotSearchServer::WriteBatch::RemoveDocument(int document_id) {
+    operations_.push_back({OperationType::REMOVE, document_id});
+}
+
+void SnapshotSearchServer::WriteBatch::RefreshImpactOrder() {
+    operations_.push_back({OperationType::REFRESH_IMPACT_ORDER});
+}
+
+bool SnapshotSearchServer::WriteBatch::Empty() const {
+    return operations_.empty();
+}
+
+SnapshotSearchServer::Snapshot::Snapshot(const SnapshotSearchServer& owner, int instance,
+    size_t stripe)
+    : owner_(&owner)
+    , instance_(instance)
+    , stripe_(stripe) {
+}
+
+SnapshotSearchServer::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : owner_(other.owner_)
+    , instance_(other.instance_)
+    , stripe_(other.stripe_) {
+
+    other.owner_ = nullptr;
+}
+
+SnapshotSearchServer::Snapshot::~Snapshot() {
+    if (owner_ != nullptr) {
+        owner_->readers_[instance_][stripe_].count.fetch_sub(1, memory_order_release);
+    }
+}
+
+const SearchServer& SnapshotSearchServer::Snapshot::operator*() const {
+    return owner_->instances_[instance_];
+}
+
+const SearchServer* SnapshotSearchServer::Snapshot::operator->() const {
+    return &owner_->instances_[instance_];
+}
+
+SnapshotSearchServer::SnapshotSearchServer(string_view stop_words_text)
+    : SnapshotSearchServer(SplitIntoWords(stop_words_text)) {
+}
+
+SnapshotSearchServer::SnapshotSearchServer(const string& stop_words_text)
+    : SnapshotSearchServer(SplitIntoWords(stop_words_text)) {
+}
+
+void SnapshotSearchServer::Apply(const WriteBatch& batch) {
+    if (batch.Empty()) {
+        return;
+    }
+
+    const lock_guard guard(writer_mutex_);
+
+    const auto apply_operation = [](SearchServer& search_server, const WriteBatch::Operation& operation) {
+        switch (operation.type) {
+            case WriteBatch::OperationType::ADD:
+                search_server.AddDocument(operation.document_id, operation.document,
+                    operation.status, operation.ratings);
+                break;
+            case WriteBatch::OperationType::REMOVE:
+                search_server.RemoveDocument(operation.document_id);
+                break;
+            case WriteBatch::OperationType::REFRESH_IMPACT_ORDER:
+                search_server.RefreshImpactOrder();
+                break;
+        }
+    };
+
+    // запасную копию после прошлой публикации никто не читает
+    const int old_instance = active_instance_.load(memory_order_relaxed);
+    const int new_instance = 1 - old_instance;
+
+    // копии перед пакетом одинаковы, поэтому ошибочная на одной операция
+    // будет ошибочной и на другой: на второй её можно просто пропустить
+    vector<bool> is_failed(batch.operations_.size(), false);
+    exception_ptr first_error;
+    for (size_t i = 0; i < batch.operations_.size(); ++i) {
+        try {
+            apply_operation(instances_[new_instance], batch.operations_[i]);
+        } catch (...) {
+            is_failed[i] = true;
+            if (!first_error) {
+                first_error = current_exception();
+            }
+        }
+    }
+
+    active_instance_.store(new_instance, memory_order_seq_cst);
+    WaitForReaders(old_instance);
+
+    for (size_t i = 0; i < batch.operations_.size(); ++i) {
+        if (!is_failed[i]) {
+            apply_operation(instances_[old_instance], batch.operations_[i]);
+        }
+    }
+
+    if (first_error) {
+        rethrow_exception(first_error);
+    }
+}
+
+void SnapshotSearchServer::AddDocument(int document_id, string_view document,
+    DocumentStatus status, const vector<int>& ratings) {
+
+    WriteBatch batch;
+    batch.AddDocument(document_id, document, status, ratings);
+    Apply(batch);
+}
+
+void SnapshotSearchServer::RemoveDocument(int document_id) {
+    WriteBatch batch;
+    batch.RemoveDocument(document_id);
+    Apply(batch);
+}
+
+SnapshotSearchServer::Snapshot SnapshotSearchServer::GetSnapshot() const {
+    const size_t stripe = hash<thread::id>{}(this_thread::get_id()) % READER_STRIPE_COUNT;
+
+    // Читатель отмечается в счётчике копии и перепроверяет, что она всё ещё
+    // активна. Писатель сначала переключает активную копию, потом читает
+    // счётчики старой; при последовательной согласованности либо писатель
+    // увидит отметку читателя, либо читатель увидит переключение и уйдёт
+    while (true) {
+        const int instance = active_instance_.load(memory_order_seq_cst);
+        auto& counter = readers_[instance][stripe].count;
+        counter.fetch_add(1, memory_order_seq_cst);
+        if (active_instance_.load(memory_order_seq_cst) == instance) {
+            return Snapshot(*this, instance, stripe);
+        }
+        counter.fetch_sub(1, memory_order_release);
+    }
+}
+
+int SnapshotSearchServer::GetDocumentCount() const {
+    const Snapshot snapshot = GetSnapshot();
+    return snapshot->GetDocumentCount();
+}
+
+void SnapshotSearchServer::WaitForReaders(int instance) const {
+    for (const ReaderCounter& reader_counter : readers_[instance]) {
+        while (reader_counter.count.load(memory_order_seq_cst) != 0) {
+            this_thread::yield();
+        }
+    }
+}
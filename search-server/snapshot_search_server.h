@@ -0,0 +1,131 @@
+#pragma once
+#include "search_server.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Поисковый сервер, допускающий запросы одновременно с изменениями.
+// Хранит две копии индекса (схема left-right): читатели работают с активной
+// копией, писатель применяет пакет изменений к запасной, атомарно делает её
+// активной, дожидается ухода читателей со старой и повторяет на ней тот же
+// пакет. Читатели никогда не ждут писателя, а памяти нужно ровно на две копии:
+// старые версии не накапливаются.
+class SnapshotSearchServer {
+public:
+    // Пакет изменений, применяемый одной публикацией
+    class WriteBatch {
+    public:
+        void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+            const std::vector<int>& ratings);
+        void RemoveDocument(int document_id);
+        void RefreshImpactOrder();
+
+        bool Empty() const;
+
+    private:
+        friend class SnapshotSearchServer;
+
+        enum class OperationType {
+            ADD,
+            REMOVE,
+            REFRESH_IMPACT_ORDER,
+        };
+
+        struct Operation {
+            OperationType type = OperationType::ADD;
+            int document_id = 0;
+            std::string document = {};
+            DocumentStatus status = DocumentStatus::ACTUAL;
+            std::vector<int> ratings = {};
+        };
+
+        std::vector<Operation> operations_;
+    };
+
+    // Закреплённая за читателем версия индекса: пока снимок жив, она не
+    // меняется. Писатель ждёт освобождения снимков старой версии, поэтому
+    // держать их дольше одного запроса не следует
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot&&) = delete;
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        ~Snapshot();
+
+        const SearchServer& operator*() const;
+        const SearchServer* operator->() const;
+
+    private:
+        friend class SnapshotSearchServer;
+
+        Snapshot(const SnapshotSearchServer& owner, int instance, size_t stripe);
+
+        const SnapshotSearchServer* owner_;
+        int instance_;
+        size_t stripe_;
+    };
+
+    template <typename StringContainer>
+    explicit SnapshotSearchServer(const StringContainer& stop_words);
+    explicit SnapshotSearchServer(std::string_view stop_words_text);
+    explicit SnapshotSearchServer(const std::string& stop_words_text);
+
+    // Применяет пакет целиком и публикует результат. Ошибочные операции
+    // (например, повторный id) пропускаются, остальные применяются, после
+    // публикации выбрасывается исключение первой ошибочной операции
+    void Apply(const WriteBatch& batch);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    Snapshot GetSnapshot() const;
+
+    // Выполняют запрос на текущем снимке; аргументы те же, что у SearchServer
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    template <typename... Args>
+    SearchServer::MatchResult MatchDocument(Args&&... args) const;
+
+    int GetDocumentCount() const;
+
+private:
+    // счётчики читателей разнесены по кэш-линиям и по потокам, чтобы
+    // параллельные запросы не конкурировали за одну переменную
+    struct alignas(64) ReaderCounter {
+        std::atomic<int> count{0};
+    };
+
+    static constexpr size_t READER_STRIPE_COUNT = 16;
+
+    std::array<SearchServer, 2> instances_;
+    std::atomic<int> active_instance_{0};
+    mutable std::array<std::array<ReaderCounter, READER_STRIPE_COUNT>, 2> readers_;
+    std::mutex writer_mutex_;
+
+    void WaitForReaders(int instance) const;
+};
+
+template <typename StringContainer>
+SnapshotSearchServer::SnapshotSearchServer(const StringContainer& stop_words)
+    : instances_{SearchServer(stop_words), SearchServer(stop_words)} {
+}
+
+template <typename... Args>
+std::vector<Document> SnapshotSearchServer::FindTopDocuments(Args&&... args) const {
+    const Snapshot snapshot = GetSnapshot();
+    return snapshot->FindTopDocuments(std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+SearchServer::MatchResult SnapshotSearchServer::MatchDocument(Args&&... args) const {
+    const Snapshot snapshot = GetSnapshot();
+    return snapshot->MatchDocument(std::forward<Args>(args)...);
+}
@@ -0,0 +1,159 @@
+#include "stop_word_set.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// Финальное перемешивание splitmix64
+uint64_t Mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+// в среднем слов на группу
+constexpr size_t GROUP_SIZE = 4;
+// перебор добавок для группы, после которого таблица увеличивается
+constexpr uint32_t MAX_SEED = 1 << 16;
+
+} // namespace
+
+bool StopWordSet::Contains(string_view word) const {
+    if (slots_.empty()) {
+        return false;
+    }
+
+    const uint64_t hash = HashWord(word);
+    const Slot& slot = slots_[GetSlot(hash, group_seeds_[GetGroup(hash)])];
+    return slot.hash == hash && slot.size == word.size()
+        && memcmp(chars_.data() + slot.offset, word.data(), word.size()) == 0;
+}
+
+size_t StopWordSet::Size() const {
+    return static_cast<size_t>(count_if(slots_.begin(), slots_.end(),
+        [](const Slot& slot) {
+            return slot.size > 0;
+        }));
+}
+
+vector<string_view> StopWordSet::GetWords() const {
+    vector<string_view> words;
+    for (const Slot& slot : slots_) {
+        if (slot.size > 0) {
+            words.push_back(string_view(chars_).substr(slot.offset, slot.size));
+        }
+    }
+    sort(words.begin(), words.end());
+    return words;
+}
+
+void StopWordSet::Build(const vector<string_view>& words) {
+    if (words.empty()) {
+        return;
+    }
+
+    vector<uint32_t> offsets;
+    vector<uint64_t> hashes;
+    for (const string_view word : words) {
+        offsets.push_back(static_cast<uint32_t>(chars_.size()));
+        hashes.push_back(HashWord(word));
+        chars_ += word;
+    }
+    // слова с одинаковым хешем не разнести по ячейкам ни при какой добавке
+    vector<uint64_t> sorted_hashes = hashes;
+    sort(sorted_hashes.begin(), sorted_hashes.end());
+    if (adjacent_find(sorted_hashes.begin(), sorted_hashes.end()) != sorted_hashes.end()) {
+        throw invalid_argument("Stop words must be unique"s);
+    }
+
+    group_seeds_.assign((words.size() + GROUP_SIZE - 1) / GROUP_SIZE, 0);
+    vector<vector<size_t>> groups(group_seeds_.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        groups[GetGroup(hashes[i])].push_back(i);
+    }
+    // большие группы размещаются первыми, пока свободных ячеек много
+    vector<size_t> group_order(groups.size());
+    iota(group_order.begin(), group_order.end(), 0);
+    stable_sort(group_order.begin(), group_order.end(),
+        [&groups](size_t lhs, size_t rhs) {
+            return groups[lhs].size() > groups[rhs].size();
+        });
+
+    // заполненность таблицы не больше половины
+    size_t slot_count = 1;
+    while (slot_count < 2 * words.size()) {
+        slot_count *= 2;
+    }
+
+    vector<size_t> group_slots;
+    while (true) {
+        slots_.assign(slot_count, Slot{});
+        slot_mask_ = slot_count - 1;
+
+        bool is_placed = true;
+        for (const size_t group : group_order) {
+            uint32_t seed = 0;
+            for (; seed < MAX_SEED; ++seed) {
+                group_slots.clear();
+                for (const size_t i : groups[group]) {
+                    const size_t slot = GetSlot(hashes[i], seed);
+                    if (slots_[slot].size > 0
+                        || find(group_slots.begin(), group_slots.end(), slot) != group_slots.end()) {
+                        break;
+                    }
+                    group_slots.push_back(slot);
+                }
+                if (group_slots.size() == groups[group].size()) {
+                    break;
+                }
+            }
+            if (seed == MAX_SEED) {
+                is_placed = false;
+                break;
+            }
+
+            group_seeds_[group] = seed;
+            for (size_t j = 0; j < groups[group].size(); ++j) {
+                const size_t i = groups[group][j];
+                slots_[group_slots[j]] = {hashes[i], offsets[i], static_cast<uint32_t>(words[i].size())};
+            }
+        }
+
+        if (is_placed) {
+            return;
+        }
+        slot_count *= 2;
+    }
+}
+
+uint64_t StopWordSet::HashWord(string_view word) {
+    uint64_t hash = Mix(word.size());
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= word.size(); i += sizeof(uint64_t)) {
+        uint64_t chunk;
+        memcpy(&chunk, word.data() + i, sizeof(chunk));
+        hash = Mix(hash ^ chunk);
+    }
+    if (i < word.size()) {
+        uint64_t chunk = 0;
+        memcpy(&chunk, word.data() + i, word.size() - i);
+        hash = Mix(hash ^ chunk);
+    }
+    return hash;
+}
+
+size_t StopWordSet::GetGroup(uint64_t hash) const {
+    return static_cast<size_t>(((hash >> 32) * group_seeds_.size()) >> 32);
+}
+
+size_t StopWordSet::GetSlot(uint64_t hash, uint32_t seed) const {
+    return static_cast<size_t>(Mix(hash + seed * 0x9E3779B97F4A7C15ull) & slot_mask_);
+}
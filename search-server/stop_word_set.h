@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Неизменяемое множество слов с совершенным хешированием (hash and
+// displace). Слова раскладываются по группам, и для каждой группы
+// подбирается своя добавка к хешу, при которой все её слова попадают в
+// свободные ячейки таблицы. Поиск вычисляет хеш слова один раз, читает
+// добавку группы и сравнивает слово ровно с одной ячейкой.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+
+    // Слова должны быть непустыми и без повторов
+    template <typename StringContainer>
+    explicit StopWordSet(const StringContainer& words);
+
+    bool Contains(std::string_view word) const;
+    size_t Size() const;
+    // Слова в порядке возрастания
+    std::vector<std::string_view> GetWords() const;
+
+private:
+    struct Slot {
+        std::uint64_t hash = 0;
+        std::uint32_t offset = 0;
+        // 0 — ячейка пуста
+        std::uint32_t size = 0;
+    };
+
+    std::string chars_;
+    std::vector<Slot> slots_;
+    std::uint64_t slot_mask_ = 0;
+    std::vector<std::uint32_t> group_seeds_;
+
+    void Build(const std::vector<std::string_view>& words);
+    static std::uint64_t HashWord(std::string_view word);
+    size_t GetGroup(std::uint64_t hash) const;
+    size_t GetSlot(std::uint64_t hash, std::uint32_t seed) const;
+};
+
+template <typename StringContainer>
+StopWordSet::StopWordSet(const StringContainer& words) {
+    std::vector<std::string_view> word_views;
+    for (const std::string_view word : words) {
+        word_views.push_back(word);
+    }
+    Build(word_views);
+}
@@ -1,21 +1,132 @@
 #include "string_processing.h"
-    
+
+#include <cstdint>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
-vector<string_view> SplitIntoWords(string_view str) {
-    vector<string_view> result;
-    const int64_t pos_end = static_cast<int64_t>(str.npos);
-    while (true) {
-        int64_t space = static_cast<int64_t>(str.find(' '));
-        string_view s = str.substr(0, static_cast<size_t>(space));
-        if (!s.empty()) {
-            result.push_back(s);
+namespace {
+
+bool IsControlChar(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+// Разбирает текст с позиции position до конца по одному байту; word_begin —
+// начало незаконченного слова
+bool SplitTail(string_view text, size_t position, size_t word_begin, vector<string_view>& words) {
+    bool is_valid = true;
+    for (; position < text.size(); ++position) {
+        const char c = text[position];
+        if (c == ' ') {
+            if (position > word_begin) {
+                words.push_back(text.substr(word_begin, position - word_begin));
+            }
+            word_begin = position + 1;
+        } else if (IsControlChar(c)) {
+            is_valid = false;
         }
-        if (space == pos_end) {
-            break;
-        } else {
-            str.remove_prefix(static_cast<size_t>(space+1));
+    }
+    if (text.size() > word_begin) {
+        words.push_back(text.substr(word_begin));
+    }
+    return is_valid;
+}
+
+#if defined(__GNUC__) && defined(__SSE2__)
+
+// Добавляет слова, которые заканчиваются пробелами из маски блока,
+// начинающегося с позиции offset
+inline void AddWordsBeforeSpaces(string_view text, size_t offset, uint32_t space_mask,
+    size_t& word_begin, vector<string_view>& words) {
+
+    while (space_mask != 0) {
+        const size_t space = offset + static_cast<size_t>(__builtin_ctz(space_mask));
+        if (space > word_begin) {
+            words.push_back(text.substr(word_begin, space - word_begin));
         }
+        word_begin = space + 1;
+        space_mask &= space_mask - 1;
+    }
+}
+
+// Байт управляющий, если три старших бита нулевые
+bool SplitSse2(string_view text, vector<string_view>& words) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    const __m128i high_bits = _mm_set1_epi8(static_cast<char>(0xE0));
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i control = zero;
+    size_t word_begin = 0;
+    size_t position = 0;
+    for (; position + sizeof(__m128i) <= text.size(); position += sizeof(__m128i)) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+        control = _mm_or_si128(control, _mm_cmpeq_epi8(_mm_and_si128(chunk, high_bits), zero));
+        const uint32_t space_mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces)));
+        AddWordsBeforeSpaces(text, position, space_mask, word_begin, words);
+    }
+
+    const bool is_valid = _mm_movemask_epi8(control) == 0;
+    return SplitTail(text, position, word_begin, words) && is_valid;
+}
+
+__attribute__((target("avx2")))
+bool SplitAvx2(string_view text, vector<string_view>& words) {
+    const __m256i spaces = _mm256_set1_epi8(' ');
+    const __m256i high_bits = _mm256_set1_epi8(static_cast<char>(0xE0));
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i control = zero;
+    size_t word_begin = 0;
+    size_t position = 0;
+    for (; position + sizeof(__m256i) <= text.size(); position += sizeof(__m256i)) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + position));
+        control = _mm256_or_si256(control, _mm256_cmpeq_epi8(_mm256_and_si256(chunk, high_bits), zero));
+        const uint32_t space_mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, spaces)));
+        AddWordsBeforeSpaces(text, position, space_mask, word_begin, words);
+    }
+
+    const bool is_valid = _mm256_movemask_epi8(control) == 0;
+    return SplitTail(text, position, word_begin, words) && is_valid;
+}
+
+#else
+
+bool SplitScalar(string_view text, vector<string_view>& words) {
+    return SplitTail(text, 0, 0, words);
+}
+
+#endif
+
+using SplitFunction = bool (*)(string_view, vector<string_view>&);
+
+SplitFunction ChooseSplitFunction() {
+#if defined(__GNUC__) && defined(__SSE2__)
+    if (__builtin_cpu_supports("avx2")) {
+        return SplitAvx2;
     }
+    return SplitSse2;
+#else
+    return SplitScalar;
+#endif
+}
+
+} // namespace
+
+vector<string_view> SplitIntoWords(string_view str) {
+    vector<string_view> result;
+    SplitIntoWords(str, result);
     return result;
-}
\ No newline at end of file
+}
+
+void SplitIntoWords(string_view str, vector<string_view>& result) {
+    SplitIntoValidWords(str, result);
+}
+
+bool SplitIntoValidWords(string_view text, vector<string_view>& words) {
+    static const SplitFunction split = ChooseSplitFunction();
+    words.clear();
+    return split(text, words);
+}
@@ -2,9 +2,16 @@
 #include <functional>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
+// Заполняет переданный вектор, не выделяя память, если его ёмкости хватает
+void SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+// То же и за тот же проход проверяет, что в тексте нет управляющих символов
+// (коды 0–31); возвращает false, если они есть. Текст просматривается
+// векторными инструкциями (AVX2 или SSE2, выбор при первом вызове)
+bool SplitIntoValidWords(std::string_view text, std::vector<std::string_view>& words);
 
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings);
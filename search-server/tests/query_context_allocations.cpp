@@ -0,0 +1,193 @@
+// Проверка: повторные запросы через SearchServer::QueryContext после прогрева
+// не обращаются к куче ни в одном режиме вычисления, ни для сырых, ни для
+// подготовленных запросов. Глобальные operator new и operator delete здесь
+// заменены считающими, поэтому файл собирается отдельно от основной
+// программы:
+//   g++ tests/query_context_allocations.cpp $(ls *.cpp | grep -v '^main.cpp$') -o query_context_allocations
+#include "../search_server.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+atomic<size_t> allocation_count{0};
+
+void* CountedAllocate(size_t size) noexcept {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* CountedAllocate(size_t size, align_val_t alignment) noexcept {
+    allocation_count.fetch_add(1, memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc требует размер, кратный выравниванию
+    return aligned_alloc(align, ((size == 0 ? 1 : size) + align - 1) / align * align);
+}
+
+void* CheckAllocated(void* ptr) {
+    if (ptr == nullptr) {
+        throw bad_alloc();
+    }
+    return ptr;
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    return CheckAllocated(CountedAllocate(size));
+}
+
+void* operator new[](size_t size) {
+    return CheckAllocated(CountedAllocate(size));
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+    return CheckAllocated(CountedAllocate(size, alignment));
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+    return CheckAllocated(CountedAllocate(size, alignment));
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    return CountedAllocate(size);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+    return CountedAllocate(size, alignment);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t, align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, const nothrow_t&) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, const nothrow_t&) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, align_val_t, const nothrow_t&) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, align_val_t, const nothrow_t&) noexcept {
+    free(ptr);
+}
+
+string GenerateText(mt19937& generator, const vector<string>& dictionary, int word_count) {
+    string text;
+    for (int i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        text += dictionary[uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)];
+    }
+    return text;
+}
+
+int main() {
+    mt19937 generator;
+    vector<string> dictionary;
+    for (int i = 0; i < 1'000; ++i) {
+        string word;
+        const int length = uniform_int_distribution(1, 10)(generator);
+        for (int j = 0; j < length; ++j) {
+            word.push_back(uniform_int_distribution('a', 'z')(generator));
+        }
+        dictionary.push_back(move(word));
+    }
+
+    SearchServer search_server(dictionary[0]);
+    for (int i = 0; i < 10'000; ++i) {
+        search_server.AddDocument(i, GenerateText(generator, dictionary, 70), 
+            DocumentStatus::ACTUAL, {1, 2, 3});
+    }
+    search_server.RefreshImpactOrder();
+
+    vector<string> queries;
+    vector<SearchServer::PreparedQuery> prepared_queries;
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(GenerateText(generator, dictionary, 10));
+        prepared_queries.push_back(search_server.PrepareQuery(queries.back()));
+    }
+
+    SearchServer::QueryContext context;
+    for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, 
+        QueryEvaluation::DYNAMIC_PRUNING, QueryEvaluation::IMPACT_ORDERED}) {
+        
+        double total_relevance = 0;
+        const auto run_queries = [&] {
+            for (size_t i = 0; i < queries.size(); ++i) {
+                for (const auto& document : search_server.FindTopDocuments(context, queries[i], 
+                    DocumentStatus::ACTUAL, 5, evaluation)) {
+                    total_relevance += document.relevance;
+                }
+                for (const auto& document : search_server.FindTopDocuments(context, prepared_queries[i], 
+                    DocumentStatus::ACTUAL, 5, evaluation)) {
+                    total_relevance += document.relevance;
+                }
+            }
+        };
+        run_queries();
+
+        const size_t allocations_before = allocation_count.load(memory_order_relaxed);
+        for (int repeat = 0; repeat < 3; ++repeat) {
+            run_queries();
+        }
+        const size_t allocations = allocation_count.load(memory_order_relaxed) - allocations_before;
+        if (allocations != 0) {
+            cerr << "query context allocated "s << allocations << " times in evaluation mode "s 
+                << static_cast<int>(evaluation) << endl;
+            return 1;
+        }
+        cout << total_relevance << endl;
+    }
+    cout << "no allocations"s << endl;
+}
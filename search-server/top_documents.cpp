@@ -0,0 +1,68 @@
+#include "top_documents.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    const double epsilon = 1e-6;
+
+    if (abs(lhs.relevance - rhs.relevance) >= epsilon) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+TopDocuments::TopDocuments(size_t capacity)
+    : capacity_(capacity) {
+}
+
+void TopDocuments::Reset(size_t capacity) {
+    capacity_ = capacity;
+    heap_.clear();
+}
+
+void TopDocuments::Push(const Document& document) {
+    if (heap_.size() < capacity_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return;
+    }
+
+    if (capacity_ == 0 || !IsMoreRelevant(document, heap_.front())) {
+        return;
+    }
+
+    pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    heap_.back() = document;
+    push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Push(document);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() == capacity_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocuments::Extract() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return move(heap_);
+}
+
+void TopDocuments::ExtractTo(vector<Document>& documents) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    documents.assign(heap_.begin(), heap_.end());
+    heap_.clear();
+}
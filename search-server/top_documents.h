@@ -0,0 +1,36 @@
+#pragma once
+#include "document.h"
+
+#include <cstddef>
+#include <vector>
+
+// Порядок выдачи: по убыванию релевантности, при равной (с точностью 1e-6)
+// релевантности — по убыванию рейтинга, затем по возрастанию id
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Ограниченная куча лучших capacity документов. Худший из отобранных лежит
+// в вершине, поэтому кандидат отсекается одним сравнением, а сортируется
+// в итоге не более capacity элементов.
+class TopDocuments {
+public:
+    explicit TopDocuments(std::size_t capacity);
+
+    // Очищает кучу и меняет ёмкость, сохраняя выделенную память
+    void Reset(std::size_t capacity);
+
+    void Push(const Document& document);
+    void Merge(const TopDocuments& other);
+
+    bool IsFull() const;
+    // Худший из отобранных документов, имеет смысл только для непустой кучи
+    const Document& GetWorst() const;
+
+    // Отобранные документы в порядке выдачи
+    std::vector<Document> Extract();
+    // То же в переданный вектор; куча остаётся пустой, но сохраняет память
+    void ExtractTo(std::vector<Document>& documents);
+
+private:
+    std::size_t capacity_;
+    std::vector<Document> heap_;
+};
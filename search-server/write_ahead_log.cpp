@@ -0,0 +1,216 @@
+#include "write_ahead_log.h"
+#include "index_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+constexpr char LOG_MAGIC[8] = {'S', 'R', 'C', 'H', 'W', 'A', 'L', '\0'};
+constexpr uint32_t LOG_VERSION = 1;
+
+struct LogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+template <typename T>
+void AppendValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool ReadValue(const char*& data, const char* end, T& value) {
+    if (static_cast<size_t>(end - data) < sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, data, sizeof(value));
+    data += sizeof(value);
+    return true;
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog(const string& path)
+    : path_(path) {
+
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Cannot create log "s + path);
+    }
+
+    LogHeader header{};
+    memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+    header.version = LOG_VERSION;
+    try {
+        WriteToFile(string(reinterpret_cast<const char*>(&header), sizeof(header)));
+    } catch (...) {
+        close(fd_);
+        throw;
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close(fd_);
+}
+
+uint64_t WriteAheadLog::AppendAddDocument(int document_id, string_view document,
+    DocumentStatus status, const vector<int>& ratings) {
+
+    string payload;
+    payload.reserve(4 * sizeof(int32_t) + ratings.size() * sizeof(int32_t) + document.size());
+    AppendValue<int32_t>(payload, document_id);
+    AppendValue<int32_t>(payload, static_cast<int32_t>(status));
+    AppendValue<uint32_t>(payload, static_cast<uint32_t>(ratings.size()));
+    AppendValue<uint32_t>(payload, static_cast<uint32_t>(document.size()));
+    for (const int rating : ratings) {
+        AppendValue<int32_t>(payload, rating);
+    }
+    payload += document;
+    return AppendRecord(OperationType::ADD_DOCUMENT, payload);
+}
+
+uint64_t WriteAheadLog::AppendRemoveDocument(int document_id) {
+    string payload;
+    AppendValue<int32_t>(payload, document_id);
+    return AppendRecord(OperationType::REMOVE_DOCUMENT, payload);
+}
+
+uint64_t WriteAheadLog::AppendRecord(OperationType type, const string& payload) {
+    string record(sizeof(RecordHeader), '\0');
+    RecordHeader header{0, static_cast<uint32_t>(payload.size()), type};
+    memcpy(record.data(), &header, sizeof(header));
+    record += payload;
+    header.checksum = index_file::ComputeChecksum(record.data() + sizeof(header.checksum),
+        record.size() - sizeof(header.checksum));
+    memcpy(record.data(), &header.checksum, sizeof(header.checksum));
+
+    const lock_guard guard(mutex_);
+    buffer_ += record;
+    return ++appended_count_;
+}
+
+void WriteAheadLog::Sync(uint64_t sequence) {
+    unique_lock lock(mutex_);
+    while (synced_count_ < sequence) {
+        if (is_failed_) {
+            throw runtime_error("Cannot write log "s + path_);
+        }
+        if (is_syncing_) {
+            synced_.wait(lock);
+            continue;
+        }
+
+        // этот поток становится ведущим и фиксирует всё, что накоплено
+        is_syncing_ = true;
+        string data;
+        data.swap(buffer_);
+        const uint64_t target_count = appended_count_;
+        lock.unlock();
+
+        bool is_written = true;
+        try {
+            WriteToFile(data);
+        } catch (...) {
+            is_written = false;
+        }
+
+        lock.lock();
+        is_syncing_ = false;
+        if (is_written) {
+            synced_count_ = target_count;
+        } else {
+            is_failed_ = true;
+        }
+        synced_.notify_all();
+    }
+}
+
+void WriteAheadLog::WriteToFile(const string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t result = write(fd_, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Cannot write log "s + path_);
+        }
+        written += static_cast<size_t>(result);
+    }
+    if (fdatasync(fd_) != 0) {
+        throw runtime_error("Cannot write log "s + path_);
+    }
+}
+
+vector<WriteAheadLog::Operation> WriteAheadLog::Parse(const char* data, size_t size) {
+    vector<Operation> operations;
+    if (size < sizeof(LogHeader)) {
+        return operations;
+    }
+    LogHeader log_header;
+    memcpy(&log_header, data, sizeof(log_header));
+    if (memcmp(log_header.magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+        throw runtime_error("Not a log file"s);
+    }
+    if (log_header.version != LOG_VERSION) {
+        throw runtime_error("Unsupported log version "s + to_string(log_header.version));
+    }
+
+    const char* position = data + sizeof(LogHeader);
+    const char* const end = data + size;
+    while (true) {
+        RecordHeader header;
+        if (!ReadValue(position, end, header)
+            || header.size > static_cast<size_t>(end - position)
+            || index_file::ComputeChecksum(position - sizeof(header) + sizeof(header.checksum),
+                   sizeof(header) - sizeof(header.checksum) + header.size) != header.checksum) {
+            break;
+        }
+
+        const char* payload = position;
+        const char* const payload_end = position + header.size;
+        position = payload_end;
+
+        Operation operation{header.type, 0, {}, DocumentStatus::ACTUAL, {}};
+        int32_t document_id = 0;
+        if (!ReadValue(payload, payload_end, document_id)) {
+            break;
+        }
+        operation.document_id = document_id;
+
+        if (header.type == OperationType::ADD_DOCUMENT) {
+            int32_t status = 0;
+            uint32_t rating_count = 0;
+            uint32_t document_size = 0;
+            if (!ReadValue(payload, payload_end, status)
+                || !ReadValue(payload, payload_end, rating_count)
+                || !ReadValue(payload, payload_end, document_size)
+                || static_cast<size_t>(payload_end - payload)
+                       != rating_count * sizeof(int32_t) + document_size) {
+                break;
+            }
+            operation.status = static_cast<DocumentStatus>(status);
+            operation.ratings.resize(rating_count);
+            for (int& rating : operation.ratings) {
+                int32_t value = 0;
+                ReadValue(payload, payload_end, value);
+                rating = value;
+            }
+            operation.document = string_view(payload, document_size);
+        } else if (header.type != OperationType::REMOVE_DOCUMENT) {
+            break;
+        }
+
+        operations.push_back(move(operation));
+    }
+
+    return operations;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "document.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Журнал изменений индекса, дописываемый в конец файла. Файл начинается
+// с заголовка, за которым идут записи: контрольная сумма, размер, тип и
+// данные операции. Запись с неверной суммой или обрезанная при сбое
+// считается концом журнала.
+class WriteAheadLog {
+public:
+    enum class OperationType : std::uint32_t {
+        ADD_DOCUMENT = 1,
+        REMOVE_DOCUMENT = 2,
+    };
+
+    // Прочитанная из журнала операция; текст документа ссылается на
+    // данные, переданные в Parse
+    struct Operation {
+        OperationType type;
+        int document_id;
+        std::string_view document;
+        DocumentStatus status;
+        std::vector<int> ratings;
+    };
+
+    // Создаёт новый пустой журнал (существующий файл перезаписывается)
+    explicit WriteAheadLog(const std::string& path);
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Добавляют запись в буфер и возвращают её номер; на диск запись
+    // попадает при Sync
+    std::uint64_t AppendAddDocument(int document_id, std::string_view document,
+        DocumentStatus status, const std::vector<int>& ratings);
+    std::uint64_t AppendRemoveDocument(int document_id);
+
+    // Дожидается, пока запись с номером sequence и все предыдущие окажутся
+    // на диске. Групповая фиксация: один из ждущих потоков записывает
+    // накопившиеся записи всех потоков и сбрасывает их одним fdatasync,
+    // остальные дожидаются его результата
+    void Sync(std::uint64_t sequence);
+
+    // Разбирает содержимое файла журнала до первой повреждённой записи
+    static std::vector<Operation> Parse(const char* data, size_t size);
+
+private:
+    struct RecordHeader {
+        // сумма остальных полей заголовка и данных
+        std::uint64_t checksum;
+        std::uint32_t size;
+        OperationType type;
+    };
+
+    std::string path_;
+    int fd_ = -1;
+
+    std::mutex mutex_;
+    std::condition_variable synced_;
+    std::string buffer_;
+    std::uint64_t appended_count_ = 0;
+    std::uint64_t synced_count_ = 0;
+    bool is_syncing_ = false;
+    bool is_failed_ = false;
+
+    std::uint64_t AppendRecord(OperationType type, const std::string& payload);
+    void WriteToFile(const std::string& data);
+};